@@ -0,0 +1,154 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a bump allocator for parsers' output.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace libpt {
+
+// Instances of this class hand out memory from large blocks.  Individual
+// allocations are never freed; instead, Reset makes all of the arena's
+// memory available again at once without returning the blocks to the
+// heap.  Memory from arenas isn't initialized and destructors aren't run
+// for objects placed in it, so it's only suitable for trivially
+// destructible types such as characters.  Arenas are movable but not
+// copyable.
+class Arena {
+
+public:
+    static const size_t DefaultBlockSize = 64 * 1024;
+
+    Arena(size_t block_size = DefaultBlockSize)
+      : BlockSize(block_size), CurrentBlock(0), Used(0) {
+        assert(this);
+        assert(block_size > 0);
+    }
+
+    Arena(const Arena &that) = delete;
+    Arena &operator=(const Arena &that) = delete;
+    Arena(Arena &&that) = default;
+    Arena &operator=(Arena &&that) = default;
+
+    // Return size bytes aligned to alignment, which must be a power of two.
+    // Requests larger than the block size get blocks of their own.
+    void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        assert(this);
+        assert(alignment && (alignment & (alignment - 1)) == 0);
+        while (CurrentBlock < Blocks.size()) {
+            auto &block = Blocks[CurrentBlock];
+            auto offset = AlignedOffset(block, Used, alignment);
+            if (offset <= block.Size && block.Size - offset >= size) {
+                Used = offset + size;
+                return block.Data.get() + offset;
+            }
+            ++CurrentBlock;
+            Used = 0;
+        }
+        Block block;
+        block.Size = std::max(BlockSize, size + alignment);
+        block.Data.reset(new char[block.Size]);
+        Blocks.push_back(std::move(block));
+        CurrentBlock = Blocks.size() - 1;
+        auto offset = AlignedOffset(Blocks.back(), 0, alignment);
+        Used = offset + size;
+        return Blocks.back().Data.get() + offset;
+    }
+
+    // Allocate an uninitialized array of count Ts.
+    template <typename T>
+    T *AllocateArray(size_t count) {
+        assert(this);
+        return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Resize the allocation at pointer from old_size to new_size bytes and
+    // return its new address.  If pointer is the most recent allocation and
+    // its block has room, it's resized in place; otherwise, new memory is
+    // allocated and the old contents are copied there.  A null pointer
+    // with an old_size of zero is allowed.
+    void *Reallocate(void *pointer, size_t old_size, size_t new_size,
+      size_t alignment = alignof(std::max_align_t)) {
+        assert(this);
+        assert(pointer || old_size == 0);
+        if (pointer && CurrentBlock < Blocks.size()) {
+            auto &block = Blocks[CurrentBlock];
+            auto start = reinterpret_cast<uintptr_t>(block.Data.get());
+            auto address = reinterpret_cast<uintptr_t>(pointer);
+            auto offset = static_cast<size_t>(address - start);
+            if (address >= start && offset + old_size == Used &&
+              block.Size - offset >= new_size) {
+                Used = offset + new_size;
+                return pointer;
+            }
+        }
+        auto result = Allocate(new_size, alignment);
+        if (old_size) {
+            memcpy(result, pointer, std::min(old_size, new_size));
+        }
+        return result;
+    }
+
+    // Make all of the arena's memory available again.  Everything that
+    // was allocated from the arena is invalidated.  The blocks are kept.
+    void Reset() {
+        assert(this);
+        CurrentBlock = 0;
+        Used = 0;
+    }
+
+    // Free all of the arena's blocks.  Everything that was allocated from
+    // the arena is invalidated.
+    void Clear() {
+        assert(this);
+        Blocks.clear();
+        Reset();
+    }
+
+    // Return the total size of the arena's blocks in bytes.
+    size_t GetCapacity() const {
+        assert(this);
+        size_t capacity = 0;
+        for (const auto &block : Blocks) {
+            capacity += block.Size;
+        }
+        return capacity;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> Data;
+        size_t Size;
+    };
+
+    static size_t AlignedOffset(const Block &block, size_t offset,
+      size_t alignment) {
+        auto address = reinterpret_cast<uintptr_t>(block.Data.get()) + offset;
+        auto aligned = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        return offset + static_cast<size_t>(aligned - address);
+    }
+
+    size_t BlockSize;
+    std::vector<Block> Blocks;
+    size_t CurrentBlock;
+    size_t Used;
+
+};  // class Arena
+
+}   // namespace libpt
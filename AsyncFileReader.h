@@ -0,0 +1,644 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for reading characters from file descriptors
+// with the reads done ahead of time, in the background, so that I/O
+// overlaps with parsing.  libpt parsers can use it in templated parsing
+// functions.  It requires POSIX.  On Linux, it uses io_uring (through the
+// raw system calls, so liburing isn't needed) when it can.  Programs using
+// it must be linked with the platform's thread library (e.g., -pthread).
+
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Exceptions.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LIBPT_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace libpt {
+
+// This selects how AsyncFileReaders fill their buffers.
+enum class AsyncReadMethod {
+    // Use io_uring if it's available and the file is a regular file;
+    // otherwise, use a thread.  If the kernel rejects the first io_uring
+    // read as unsupported, the reader switches to a thread.
+    Automatic,
+
+    // Submit reads to an io_uring.  This only works for regular files.
+    IOUring,
+
+    // Read with read() on a background thread.  This works for any file
+    // descriptor, including pipes and sockets.
+    Thread
+};
+
+// Instances of this class read bytes from file descriptors through a ring
+// of buffers that are filled in the background.  ReadBlock hands the next
+// filled buffer to the caller and gives the previous one back to be
+// refilled, so while the caller parses one block, the following ones are
+// being read.  Blocks remain valid until the next call to ReadBlock,
+// ReadChar, or TryReadChar that needs a new block.
+//
+// With io_uring, reads are submitted for every free buffer at increasing
+// offsets, so several reads can be in flight at once.  With a thread, the
+// thread reads into each free buffer in turn with read().  Read errors
+// end the stream; Error and GetErrno report them.
+//
+// AsyncFileReaders are neither copyable nor movable.  Destroying one waits
+// for the reads in flight, so if the thread is blocked reading a pipe or a
+// socket, the destructor waits until the read returns.
+class AsyncFileReader {
+
+public:
+    static const size_t DefaultBlockSize = 256 * 1024;
+    static const size_t DefaultBufferCount = 4;
+
+    AsyncFileReader() = delete;
+
+    // Open the file at the specified path and start reading it.  This
+    // throws FileOpenException if the file can't be opened or examined and
+    // IOException if the reads can't be started (e.g., if method is
+    // IOUring and io_uring isn't available).  The descriptor is closed
+    // when the reader is destroyed.
+    AsyncFileReader(const char *path, size_t block_size = DefaultBlockSize,
+      size_t buffer_count = DefaultBufferCount,
+      AsyncReadMethod method = AsyncReadMethod::Automatic)
+      : Descriptor(-1), OwnsDescriptor(true) {
+        assert(this);
+        assert(path);
+        Descriptor = open(path, O_RDONLY);
+        if (Descriptor == -1) {
+            throw FileOpenException(path, errno);
+        }
+        try {
+            Start(path, block_size, buffer_count, method);
+        } catch (...) {
+            close(Descriptor);
+            throw;
+        }
+    }
+
+    // Start reading the file descriptor fd from its current position.
+    // The descriptor isn't closed: Its management is left to others, but
+    // it mustn't be used until the reader is destroyed.
+    AsyncFileReader(int fd, size_t block_size = DefaultBlockSize,
+      size_t buffer_count = DefaultBufferCount,
+      AsyncReadMethod method = AsyncReadMethod::Automatic)
+      : Descriptor(fd), OwnsDescriptor(false) {
+        assert(this);
+        assert(fd >= 0);
+        Start(nullptr, block_size, buffer_count, method);
+    }
+
+    AsyncFileReader(const AsyncFileReader &that) = delete;
+    AsyncFileReader &operator=(const AsyncFileReader &that) = delete;
+
+    ~AsyncFileReader() {
+        assert(this);
+        Stop();
+        if (OwnsDescriptor) {
+            close(Descriptor);
+        }
+    }
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !FetchBlock()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !FetchBlock()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !FetchBlock()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return AtEnd && Current == End; }
+    inline bool Error() { assert(this); return ErrorValue != 0; }
+
+    // Return the errno value of the read that failed or zero if none did.
+    inline int GetErrno() const { assert(this); return ErrorValue; }
+
+    // Return the method that the reader uses (never Automatic).
+    AsyncReadMethod GetMethod() const { assert(this); return Method; }
+
+private:
+    struct Buffer {
+        Buffer() : Size(0), Offset(0), Filled(false), Last(false),
+          Error(0) {}
+
+        std::unique_ptr<char[]> Data;
+        size_t Size;
+
+        // the file offset of the buffer's first byte (io_uring only)
+        off_t Offset;
+
+        // true if the buffer belongs to the consumer, either because it's
+        // waiting to be delivered or because it's been delivered and
+        // the consumer hasn't asked for the next one yet
+        bool Filled;
+
+        // true if no buffers follow this one
+        bool Last;
+        int Error;
+    };
+
+    void Start(const char *source, size_t block_size, size_t buffer_count,
+      AsyncReadMethod method) {
+        assert(this);
+        assert(block_size > 0);
+        assert(buffer_count > 0);
+        BlockSize = block_size;
+        Buffers.resize(buffer_count);
+        for (auto &buffer : Buffers) {
+            buffer.Data.reset(new char[block_size]);
+        }
+        Next = 0;
+        Holding = false;
+        Current = End = nullptr;
+        AtEnd = false;
+        ErrorValue = 0;
+        Stopping = false;
+        struct stat info;
+        if (fstat(Descriptor, &info) == -1) {
+            throw FileOpenException(source, errno);
+        }
+        auto regular = S_ISREG(info.st_mode);
+        MayFallBack = method == AsyncReadMethod::Automatic;
+        if (method == AsyncReadMethod::Automatic) {
+            method = regular && StartRing() ? AsyncReadMethod::IOUring
+              : AsyncReadMethod::Thread;
+        } else if (method == AsyncReadMethod::IOUring) {
+            if (!regular) {
+                throw IOException(source, EINVAL);
+            } else if (!StartRing()) {
+                throw IOException(source, errno);
+            }
+        }
+        Method = method;
+        if (Method == AsyncReadMethod::IOUring) {
+            SubmitAll();
+        } else {
+            Worker = std::thread([this]() { Work(); });
+        }
+    }
+
+    void Stop() {
+        assert(this);
+        if (Method == AsyncReadMethod::IOUring) {
+            StopRing();
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                Stopping = true;
+            }
+            Changed.notify_all();
+
+            // FallBack doesn't start the thread if it can't seek.
+            if (Worker.joinable()) {
+                Worker.join();
+            }
+        }
+    }
+
+    // Give the buffer that the consumer is done with back to the filler
+    // and point Current and End at the next filled buffer.  Return false
+    // at the end of the stream.
+    bool FetchBlock() {
+        assert(this);
+        if (AtEnd) {
+            return false;
+        }
+        if (Holding) {
+            Release(Buffers[Held]);
+            Holding = false;
+        }
+        Held = Next;
+        Next = (Next + 1) % Buffers.size();
+        auto &buffer = Buffers[Held];
+        Acquire(buffer);
+        Holding = true;
+        if (buffer.Last) {
+            AtEnd = true;
+            ErrorValue = buffer.Error;
+        }
+        Current = buffer.Data.get();
+        End = Current + buffer.Size;
+        return Current != End;
+    }
+
+    void Release(Buffer &buffer) {
+        assert(this);
+        if (Method == AsyncReadMethod::IOUring) {
+            buffer.Filled = false;
+            if (!RingFinished) {
+                Submit(buffer);
+            }
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                buffer.Filled = false;
+            }
+            Changed.notify_all();
+        }
+    }
+
+    // Wait until buffer is filled.
+    void Acquire(Buffer &buffer) {
+        assert(this);
+        if (Method == AsyncReadMethod::IOUring) {
+            while (!buffer.Filled) {
+                if (!Reap(true)) {
+                    Fail(buffer, errno);
+                }
+            }
+            if (MayFallBack && (buffer.Error == EINVAL ||
+              buffer.Error == EOPNOTSUPP)) {
+                // The kernel rejected the read (e.g., because it doesn't
+                // support IORING_OP_READ), so read with a thread instead.
+                FallBack();
+            }
+        }
+        if (Method == AsyncReadMethod::Thread) {
+            std::unique_lock<std::mutex> lock(Mutex);
+            Changed.wait(lock, [&buffer]() { return buffer.Filled; });
+        }
+        MayFallBack = false;
+    }
+
+    // Make buffer the last one, with the specified error.
+    void Fail(Buffer &buffer, int error) {
+        assert(this);
+        buffer.Error = error;
+        buffer.Last = true;
+        buffer.Filled = true;
+        RingFinished = true;
+    }
+
+    // Tear down the io_uring and start reading the file from the beginning
+    // with a thread.  This is only done before any block is delivered.
+    void FallBack() {
+        assert(this);
+        assert(Method == AsyncReadMethod::IOUring);
+        auto offset = StartOffset;
+        StopRing();
+        for (auto &buffer : Buffers) {
+            buffer.Size = 0;
+            buffer.Filled = buffer.Last = false;
+            buffer.Error = 0;
+        }
+        Method = AsyncReadMethod::Thread;
+        MayFallBack = false;
+        if (lseek(Descriptor, offset, SEEK_SET) == -1) {
+            Fail(Buffers[Held], errno);
+            return;
+        }
+        Worker = std::thread([this]() { Work(); });
+    }
+
+    // This is the background thread's loop.  It fills the buffers in ring
+    // order, one read() per buffer, until the end of the file, an error,
+    // or Stop.
+    void Work() {
+        assert(this);
+        for (size_t index = 0; ; index = (index + 1) % Buffers.size()) {
+            auto &buffer = Buffers[index];
+            {
+                std::unique_lock<std::mutex> lock(Mutex);
+                Changed.wait(lock, [this, &buffer]() {
+                    return Stopping || !buffer.Filled;
+                });
+                if (Stopping) {
+                    return;
+                }
+            }
+            ssize_t size;
+            do {
+                size = read(Descriptor, buffer.Data.get(), BlockSize);
+            } while (size == -1 && errno == EINTR);
+            auto error = size == -1 ? errno : 0;
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                buffer.Size = size > 0 ? static_cast<size_t>(size) : 0;
+                buffer.Last = size <= 0;
+                buffer.Error = error;
+                buffer.Filled = true;
+            }
+            Changed.notify_all();
+            if (size <= 0) {
+                return;
+            }
+        }
+    }
+
+#if defined(LIBPT_IO_URING)
+    // Set up the io_uring and map its rings.  Return false and set errno
+    // if that fails.
+    bool StartRing() {
+        assert(this);
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        auto fd = syscall(__NR_io_uring_setup,
+          static_cast<unsigned>(Buffers.size()), &params);
+        if (fd < 0) {
+            return false;
+        }
+        RingDescriptor = static_cast<int>(fd);
+        SubmissionRingSize = params.sq_off.array +
+          params.sq_entries * sizeof(unsigned);
+        CompletionRingSize = params.cq_off.cqes +
+          params.cq_entries * sizeof(io_uring_cqe);
+        EntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+        SubmissionRing = MapRing(SubmissionRingSize, IORING_OFF_SQ_RING);
+        CompletionRing = MapRing(CompletionRingSize, IORING_OFF_CQ_RING);
+        Entries = static_cast<io_uring_sqe *>(MapRing(EntriesSize,
+          IORING_OFF_SQES));
+        if (!SubmissionRing || !CompletionRing || !Entries) {
+            auto error = errno;
+            UnmapRing();
+            errno = error;
+            return false;
+        }
+        auto submissions = static_cast<char *>(SubmissionRing);
+        SubmissionTail = reinterpret_cast<unsigned *>(submissions +
+          params.sq_off.tail);
+        SubmissionMask = *reinterpret_cast<unsigned *>(submissions +
+          params.sq_off.ring_mask);
+        SubmissionArray = reinterpret_cast<unsigned *>(submissions +
+          params.sq_off.array);
+        auto completions = static_cast<char *>(CompletionRing);
+        CompletionHead = reinterpret_cast<unsigned *>(completions +
+          params.cq_off.head);
+        CompletionTail = reinterpret_cast<unsigned *>(completions +
+          params.cq_off.tail);
+        CompletionMask = *reinterpret_cast<unsigned *>(completions +
+          params.cq_off.ring_mask);
+        Completions = reinterpret_cast<io_uring_cqe *>(completions +
+          params.cq_off.cqes);
+        InFlight = 0;
+        RingFinished = false;
+        NextOffset = lseek(Descriptor, 0, SEEK_CUR);
+        if (NextOffset == -1) {
+            NextOffset = 0;
+        }
+        StartOffset = NextOffset;
+        return true;
+    }
+
+    void *MapRing(size_t size, off_t offset) {
+        assert(this);
+        auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, RingDescriptor, offset);
+        return address == MAP_FAILED ? nullptr : address;
+    }
+
+    void UnmapRing() {
+        assert(this);
+        if (Entries) {
+            munmap(Entries, EntriesSize);
+        }
+        if (CompletionRing) {
+            munmap(CompletionRing, CompletionRingSize);
+        }
+        if (SubmissionRing) {
+            munmap(SubmissionRing, SubmissionRingSize);
+        }
+        close(RingDescriptor);
+    }
+
+    // Wait for the reads in flight (the kernel writes into the buffers)
+    // and tear down the ring.
+    void StopRing() {
+        assert(this);
+        RingFinished = true;
+        while (InFlight != 0 && Reap(true)) {}
+        UnmapRing();
+    }
+
+    void SubmitAll() {
+        assert(this);
+        for (auto &buffer : Buffers) {
+            Submit(buffer);
+        }
+    }
+
+    // Start filling buffer from the next unread offset.
+    void Submit(Buffer &buffer) {
+        assert(this);
+        buffer.Size = 0;
+        buffer.Offset = NextOffset;
+        NextOffset += static_cast<off_t>(BlockSize);
+        SubmitRead(buffer);
+    }
+
+    // Submit a read for the unfilled part of buffer.
+    void SubmitRead(Buffer &buffer) {
+        assert(this);
+        auto tail = *SubmissionTail;
+        auto index = tail & SubmissionMask;
+        auto &entry = Entries[index];
+        memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_READ;
+        entry.fd = Descriptor;
+        entry.addr = reinterpret_cast<uintptr_t>(buffer.Data.get() +
+          buffer.Size);
+        entry.len = static_cast<unsigned>(BlockSize - buffer.Size);
+        entry.off = static_cast<uint64_t>(buffer.Offset) + buffer.Size;
+        entry.user_data = static_cast<uint64_t>(&buffer - Buffers.data());
+        SubmissionArray[index] = index;
+        __atomic_store_n(SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+        ++InFlight;
+        while (syscall(__NR_io_uring_enter, RingDescriptor, 1, 0, 0,
+          nullptr, 0) < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if ((errno == EAGAIN || errno == EBUSY) && InFlight > 1) {
+                // The kernel is out of room for completions; handling
+                // the ones for the other reads frees some.
+                if (Reap(true)) {
+                    continue;
+                }
+            } else if (errno == EAGAIN || errno == EBUSY) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // The kernel didn't take the entry, so fail the buffer.
+            --InFlight;
+            Fail(buffer, errno);
+            return;
+        }
+    }
+
+    // Handle the completions that are ready, waiting for at least one if
+    // wait is true.  Return false if waiting failed.
+    bool Reap(bool wait) {
+        assert(this);
+        auto head = *CompletionHead;
+        if (wait && head == __atomic_load_n(CompletionTail,
+          __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, RingDescriptor, 0, 1,
+              IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+        // Reads are resubmitted after the completions are consumed, since
+        // SubmitRead can call Reap.
+        Resubmissions.clear();
+        auto tail = __atomic_load_n(CompletionTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const auto &completion = Completions[head & CompletionMask];
+            auto &buffer = Buffers[completion.user_data];
+            auto result = completion.res;
+            --InFlight;
+            if (result == -EINTR || result == -EAGAIN) {
+                Resubmissions.push_back(completion.user_data);
+            } else if (result < 0) {
+                Fail(buffer, -result);
+            } else if (result == 0) {
+                buffer.Last = true;
+                buffer.Filled = true;
+                RingFinished = true;
+            } else {
+                buffer.Size += static_cast<size_t>(result);
+                if (buffer.Size < BlockSize && !RingFinished) {
+                    // Short reads only happen at the end of the file (or
+                    // if it's growing), so ask for the rest.
+                    Resubmissions.push_back(completion.user_data);
+                } else {
+                    buffer.Filled = true;
+                }
+            }
+        }
+        __atomic_store_n(CompletionHead, head, __ATOMIC_RELEASE);
+        if (!Resubmissions.empty()) {
+            auto resubmissions = Resubmissions;
+            for (auto index : resubmissions) {
+                SubmitRead(Buffers[index]);
+            }
+        }
+        return true;
+    }
+
+    int RingDescriptor;
+    void *SubmissionRing;
+    size_t SubmissionRingSize;
+    void *CompletionRing;
+    size_t CompletionRingSize;
+    io_uring_sqe *Entries;
+    size_t EntriesSize;
+    unsigned *SubmissionTail;
+    unsigned SubmissionMask;
+    unsigned *SubmissionArray;
+    unsigned *CompletionHead;
+    unsigned *CompletionTail;
+    unsigned CompletionMask;
+    io_uring_cqe *Completions;
+
+    // the number of reads that the kernel hasn't completed
+    size_t InFlight;
+
+    // true once the end of the file or an error has been reached, after
+    // which no more reads are submitted
+    bool RingFinished;
+
+    // the file offset of the first byte that no read has been submitted
+    // for yet
+    off_t NextOffset;
+
+    // the file offset of the first byte that the ring read
+    off_t StartOffset;
+
+    // the indices of the buffers whose reads Reap must resubmit
+    std::vector<size_t> Resubmissions;
+#else
+    bool StartRing() { errno = ENOSYS; return false; }
+    void StopRing() {}
+    void SubmitAll() {}
+    void Submit(Buffer &) {}
+    bool Reap(bool) { return false; }
+
+    bool RingFinished;
+    off_t StartOffset;
+#endif
+
+    int Descriptor;
+    bool OwnsDescriptor;
+    AsyncReadMethod Method;
+
+    // true if the method was Automatic and no block has been delivered
+    // yet, so the reader can still switch from io_uring to a thread
+    bool MayFallBack;
+    size_t BlockSize;
+    std::vector<Buffer> Buffers;
+
+    // the index of the next buffer to deliver
+    size_t Next;
+
+    // the index of the buffer that the consumer is reading, if Holding
+    // is true
+    size_t Held;
+    bool Holding;
+
+    // the unread part of the held buffer
+    const char *Current;
+    const char *End;
+
+    bool AtEnd;
+    int ErrorValue;
+
+    // These synchronize the consumer with the background thread.
+    bool Stopping;
+    std::mutex Mutex;
+    std::condition_variable Changed;
+    std::thread Worker;
+
+};  // class AsyncFileReader
+
+}   // namespace libpt
@@ -17,11 +17,282 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <Arena.h>
+#include <DSVScan.h>
 #include <Exceptions.h>
 
 namespace libpt {
 
+// This is the state of a DSVParser between characters, which GetState
+// returns and SetState restores (e.g., from a checkpoint; see
+// DSVCheckpoint.h).  It doesn't include Derived's state or the parser's
+// statistics.
+struct DSVParserState {
+    bool Escaping;
+    bool InRecord;
+    bool Skipping;
+    bool FieldWanted;
+    size_t FieldIndex;
+};
+
+// This is the default instrumentation policy for DSVParser's Statistics
+// parameter.  It collects nothing.  Other policies must define the same
+// methods, which the parser invokes as follows:
+//
+//     * OnBufferStart and OnBufferEnd when FeedCharacters (or Parse, for
+//       block readers) starts and finishes parsing a range of characters;
+//       OnBufferEnd gets the range's size
+//     * OnCharacter when FeedCharacter is called or Parse reads a
+//       character from a reader that lacks ReadBlock
+//     * OnFieldCharacters with the number of characters passed to Derived
+//       for a field, possibly several times per field
+//     * OnFieldEnd and OnRecordEnd when the parser calls Derived's
+//       OnFieldEnd and OnRecordEnd, respectively
+//     * OnRecordSkipped when a record ends that Derived's ShouldSkipRecord
+//       asked the parser to skip
+//     * OnEscape when the parser parses an unescaped escape character
+//     * OnReset when the parser is reset
+//
+// Policies are copied along with their parsers.
+class NoDSVStatistics {
+
+public:
+    void OnBufferStart() {}
+    void OnBufferEnd(size_t) {}
+    void OnCharacter() {}
+    void OnFieldCharacters(size_t) {}
+    void OnFieldEnd() {}
+    void OnRecordEnd() {}
+    void OnRecordSkipped() {}
+    void OnEscape() {}
+    void OnReset() {}
+
+};    // class NoDSVStatistics
+
+// This instrumentation policy counts characters, buffers, records, fields,
+// and escape characters and tracks the size of the longest field.  The
+// counters are plain members of the parser, so they're updated without
+// synchronization; read them from the parsing thread or between calls.
+class DSVStatistics {
+
+public:
+    DSVStatistics() { assert(this); Clear(); }
+
+    void OnBufferStart() {}
+
+    void OnBufferEnd(size_t size) {
+        assert(this);
+        Characters += size;
+        ++Buffers;
+    }
+
+    void OnCharacter() { assert(this); ++Characters; }
+    void OnFieldCharacters(size_t size) { assert(this); FieldSize += size; }
+
+    void OnFieldEnd() {
+        assert(this);
+        ++Fields;
+        MaxFieldSize = std::max(MaxFieldSize, FieldSize);
+        FieldSize = 0;
+    }
+
+    void OnRecordEnd() { assert(this); ++Records; }
+    void OnRecordSkipped() { assert(this); ++SkippedRecords; }
+    void OnEscape() { assert(this); ++Escapes; }
+    void OnReset() { assert(this); FieldSize = 0; }
+
+    // Return the number of characters fed to the parser.
+    size_t GetCharacters() const { assert(this); return Characters; }
+
+    // Return the number of ranges passed to FeedCharacters.
+    size_t GetBuffers() const { assert(this); return Buffers; }
+
+    // Return the numbers of records and fields delivered to Derived.
+    size_t GetRecords() const { assert(this); return Records; }
+    size_t GetFields() const { assert(this); return Fields; }
+
+    size_t GetSkippedRecords() const {
+        assert(this);
+        return SkippedRecords;
+    }
+
+    size_t GetEscapes() const { assert(this); return Escapes; }
+
+    // Return the size of the longest field delivered to Derived (after
+    // unescaping).
+    size_t GetMaxFieldSize() const { assert(this); return MaxFieldSize; }
+
+    void Clear() {
+        assert(this);
+        Characters = Buffers = Records = Fields = SkippedRecords = 0;
+        Escapes = MaxFieldSize = FieldSize = 0;
+    }
+
+    // These copy the counters (including the size of the current field)
+    // to and from arrays of CounterCount values for checkpoints.
+    static const size_t CounterCount = 8;
+
+    void GetCounters(uint64_t *counters) const {
+        assert(this);
+        assert(counters);
+        const size_t values[CounterCount] = { Characters, Buffers, Records,
+          Fields, SkippedRecords, Escapes, MaxFieldSize, FieldSize };
+        std::copy(values, values + CounterCount, counters);
+    }
+
+    void SetCounters(const uint64_t *counters) {
+        assert(this);
+        assert(counters);
+        size_t *values[CounterCount] = { &Characters, &Buffers, &Records,
+          &Fields, &SkippedRecords, &Escapes, &MaxFieldSize, &FieldSize };
+        for (size_t index = 0; index < CounterCount; ++index) {
+            *values[index] = static_cast<size_t>(counters[index]);
+        }
+    }
+
+private:
+    size_t Characters;
+    size_t Buffers;
+    size_t Records;
+    size_t Fields;
+    size_t SkippedRecords;
+    size_t Escapes;
+    size_t MaxFieldSize;
+
+    // the size of the current field so far
+    size_t FieldSize;
+
+};    // class DSVStatistics
+
+// This instrumentation policy is a DSVStatistics that also measures the
+// time spent in FeedCharacters with std::chrono::steady_clock, which is
+// read twice per range (but never per character).
+class TimedDSVStatistics : public DSVStatistics {
+
+public:
+    TimedDSVStatistics() : Elapsed(std::chrono::steady_clock::duration()) {
+        assert(this);
+    }
+
+    void OnBufferStart() {
+        assert(this);
+        Start = std::chrono::steady_clock::now();
+    }
+
+    void OnBufferEnd(size_t size) {
+        assert(this);
+        Elapsed += std::chrono::steady_clock::now() - Start;
+        DSVStatistics::OnBufferEnd(size);
+    }
+
+    // Return the time spent parsing ranges in seconds.
+    double GetSeconds() const {
+        assert(this);
+        return std::chrono::duration<double>(Elapsed).count();
+    }
+
+    // Return the number of characters parsed per second of GetSeconds.
+    double GetCharactersPerSecond() const {
+        assert(this);
+        auto seconds = GetSeconds();
+        return seconds > 0 ? GetCharacters() / seconds : 0;
+    }
+
+    void Clear() {
+        assert(this);
+        DSVStatistics::Clear();
+        Elapsed = std::chrono::steady_clock::duration();
+    }
+
+private:
+    std::chrono::steady_clock::time_point Start;
+    std::chrono::steady_clock::duration Elapsed;
+
+};    // class TimedDSVStatistics
+
+namespace detail {
+
+// This is true if T has static constant members called Separator and
+// Escape that are CharTs.
+template <typename CharT, typename T>
+struct HasStaticDSVDelimiters {
+    template <typename U>
+    static auto Test(int) -> decltype(
+      std::integral_constant<CharT, U::Separator>(),
+      std::integral_constant<CharT, U::Escape>(),
+      std::true_type());
+    template <typename U>
+    static std::false_type Test(...);
+
+    static const bool value = decltype(Test<T>(0))::value;
+};
+
+// This is the class whose static constant members Separator and Escape
+// are the delimiters of a parser or writer with the specified Delimiters
+// policy and Derived class (see DSVParser): Delimiters if it isn't void,
+// Derived if it has the members, or void if the delimiters are only known
+// at run time.  Derived must be complete.
+template <typename CharT, typename Delimiters, typename Derived = void>
+using StaticDSVDelimiterSource = typename std::conditional<
+  !std::is_void<Delimiters>::value, Delimiters,
+  typename std::conditional<HasStaticDSVDelimiters<CharT, Derived>::value,
+    Derived, void>::type>::type;
+
+// This provides the delimiters for a StaticDSVDelimiterSource, Source.  If
+// Source is void, GetSeparator and GetEscape return the run-time
+// characters passed to them and IsRunTime is std::true_type.  Otherwise,
+// they return Source's constants, IsRunTime is std::false_type, and the
+// constants are built into the scanning functions.
+template <typename CharT, typename Source,
+  bool RunTime = std::is_void<Source>::value>
+struct DSVDelimiterTraits {
+    typedef std::true_type IsRunTime;
+
+    static CharT GetSeparator(CharT separator) { return separator; }
+    static CharT GetEscape(CharT escape) { return escape; }
+
+    // Return a pointer to the first separator, escape, or newline in
+    // [begin, end).
+    static const CharT *FindSpecial(const CharT *begin, const CharT *end,
+      CharT separator, CharT escape) {
+        return FindDSVSpecial(begin, end, separator, escape);
+    }
+
+    // Return a pointer to the first escape or newline in [begin, end).
+    static const CharT *FindEscapeOrNewline(const CharT *begin,
+      const CharT *end, CharT escape) {
+        return FindDSVSpecial(begin, end, escape, escape);
+    }
+};
+
+template <typename CharT, typename Source>
+struct DSVDelimiterTraits<CharT, Source, false> {
+    typedef std::false_type IsRunTime;
+
+    static CharT GetSeparator(CharT) { return Source::Separator; }
+    static CharT GetEscape(CharT) { return Source::Escape; }
+
+    static const CharT *FindSpecial(const CharT *begin, const CharT *end,
+      CharT, CharT) {
+        return FindDSVSpecial<CharT, Source::Separator, Source::Escape>(
+          begin, end);
+    }
+
+    static const CharT *FindEscapeOrNewline(const CharT *begin,
+      const CharT *end, CharT) {
+        return FindDSVSpecial<CharT, Source::Escape, Source::Escape>(begin,
+          end);
+    }
+};
+
+}   // namespace detail
+
 // This class parses delimiter-separated values in text streams.
 // The format is specified in the text mentioned at the beginning
 // of this file.
@@ -33,7 +304,10 @@ namespace libpt {
 //       which is invoked when a new record is being parsed
 //     * a method called OnFieldCharacter taking a single _CharT,
 //       which is invoked when the parser parses a character within
-//       a record's field
+//       a record's field, and/or a method called OnFieldChunk taking
+//       two const _CharT pointers (begin and end), which is invoked
+//       with a run of consecutive characters within a record's field
+//       (see below)
 //     * a method called OnFieldEnd taking no parameters,
 //       which is invoked when the parser is finished parsing a field
 //     * a method called OnRecordEnd taking no parameters,
@@ -45,15 +319,72 @@ namespace libpt {
 //     * a method called GetEscape taking no parameters, which
 //       returns the DSV escape character as a _CharT
 //
+// (GetSeparator and GetEscape aren't required if the delimiters are
+// known at compile time; see below.)
+//
 // All of these methods must be publicly accessible unless Derived declares
 // DSVParser<Derived> a friend class.
-template <typename Derived, typename _CharT = char>
+//
+// Derived may define OnFieldCharacter, OnFieldChunk, or both.  When parsing
+// blocks of characters (see FeedCharacters), the parser passes each run of
+// ordinary field characters to OnFieldChunk in a single call if Derived
+// defines it; otherwise it calls OnFieldCharacter once per character.
+// Lone characters (e.g., those passed to FeedCharacter) go to
+// OnFieldCharacter if Derived defines it and to OnFieldChunk otherwise.
+// A field's characters may be split across several chunks (e.g., around
+// escape characters), and the pointers passed to OnFieldChunk are only
+// valid for the duration of the call unless the call comes from
+// FeedCharacters, in which case they point into FeedCharacters' range.
+//
+// FeedCharacters finds runs with FindDSVSpecial (see DSVScan.h), which is
+// vectorized for chars.  It (and FeedBuffer) can be called with arbitrary
+// pieces of the input, such as network packets: Parsing resumes exactly
+// where the previous piece left off, even in the middle of a field or
+// after an escape character.  If Derived defines a method called
+// OnBufferEnd taking no parameters, FeedCharacters calls it before
+// returning so that Derived can copy whatever it still needs out of the
+// range; DSVSpanParser (see below) does this.
+//
+// Derived may also define the following methods to avoid callbacks for
+// data it doesn't need:
+//
+//     * a method called IsFieldWanted taking a field's index (a size_t,
+//       starting at zero for each record) and returning a bool, which is
+//       invoked when each field starts; if it returns false, the parser
+//       doesn't pass the field's characters to Derived and doesn't call
+//       OnFieldEnd for it (a static mask of wanted fields can be tested
+//       inline)
+//     * a method called ShouldSkipRecord taking no parameters and
+//       returning a bool, which is invoked after each call to OnFieldEnd;
+//       if it returns true, the parser skips the rest of the record
+//       without calling Derived (not even OnRecordEnd), scanning for the
+//       next unescaped newline with FindDSVSpecial
+//
+// GetFieldIndex returns the index of the field being parsed, so Derived's
+// callbacks can tell which field they're for.
+//
+// The separator and escape characters can be fixed at compile time in
+// two ways.  Delimiters may be a policy class with static constant members
+// called Separator and Escape, such as an instance of DSVDelimiters (see
+// below).  Otherwise, if Delimiters is void and Derived has static constant
+// members called Separator and Escape (as it does if it inherits
+// UnixDSVParser), the parser uses those.  Either way, the parser never
+// calls GetSeparator or GetEscape and the characters are built into the
+// comparisons and scanning code.
+//
+// Statistics is an instrumentation policy (see NoDSVStatistics below).
+// The parser calls its methods inline, so the default policy, which does
+// nothing, costs nothing, and counting policies don't need to intrude on
+// Derived's callbacks.  GetStatistics returns the parser's instance.
+template <typename Derived, typename _CharT = char,
+  typename Delimiters = void, typename Statistics = NoDSVStatistics>
 class DSVParser {
 
 public:
     typedef _CharT CharT;
 
-    DSVParser() : Escaping(false), InRecord(false) {
+    DSVParser() : Escaping(false), InRecord(false), Skipping(false),
+      FieldWanted(true), FieldIndex(0) {
         assert(this);
     }
 
@@ -66,7 +397,7 @@ public:
     ~DSVParser() {
         assert(this);
         FinishParsing();
-        Escaping = InRecord = false;
+        Escaping = InRecord = Skipping = false;
     }
 
     DSVParser &operator=(const DSVParser &that) {
@@ -79,33 +410,93 @@ public:
     // Feed the parser a single character.
     void FeedCharacter(CharT c) {
         assert(this);
+        Stats.OnCharacter();
         HandleParsedCharacter(c);
     }
 
+    // Feed the parser the characters in the range [begin, end).  Runs of
+    // characters that are neither separators, escapes, nor newlines are
+    // passed to Derived in bulk.  If the separator and escape characters
+    // aren't known at compile time, they're retrieved from Derived once
+    // per call.
+    void FeedCharacters(const CharT *begin, const CharT *end) {
+        assert(this);
+        assert(begin <= end);
+        const CharT separator = GetSeparatorChar();
+        const CharT escape = GetEscapeChar();
+        const auto size = static_cast<size_t>(end - begin);
+        Stats.OnBufferStart();
+        while (begin != end) {
+            if (Skipping) {
+                begin = SkipRecord(begin, end, escape);
+                continue;
+            }
+            if (Escaping) {
+                if (FieldWanted) {
+                    EmitChunk(begin, begin + 1);
+                }
+                Escaping = false;
+                ++begin;
+                continue;
+            }
+            auto run_end = FindSpecial(begin, end, separator, escape);
+            if (run_end == begin) {
+                HandleParsedCharacter(*begin++);
+                continue;
+            }
+            if (!InRecord) {
+                StartRecord();
+            }
+            if (FieldWanted) {
+                EmitChunk(begin, run_end);
+            }
+            begin = run_end;
+        }
+        Stats.OnBufferEnd(size);
+        EndBuffer(decltype(TestOnBufferEnd<Derived>(0))());
+    }
+
+    // Feed the parser the size characters starting at buffer.  This is
+    // equivalent to FeedCharacters(buffer, buffer + size).
+    void FeedBuffer(const CharT *buffer, size_t size) {
+        assert(this);
+        assert(buffer || size == 0);
+        FeedCharacters(buffer, buffer + size);
+    }
+
     // Call this when you finish parsing.  The destructor will do this
     // for you automatically.
     void FinishParsing() {
         assert(this);
         if (InRecord) {
-            AsDerived()->OnFieldEnd();
-            Escaping = InRecord = false;
-            AsDerived()->OnRecordEnd();
+            Escaping = false;
+
+            // A skipped record's last field has already ended.
+            if (!Skipping) {
+                EndField();
+            }
+            EndRecord();
         }
     }
 
     // Parse the specified stream.  This does not call FinishParsing.
     // Reader must be a reader class that implements at least ReadChar
     // and IsEOF.  FileReader is an example of an acceptable reader.
+    //
+    // If Reader also implements ReadBlock, a method taking a pointer to
+    // a const CharT pointer, pointing it at the reader's next contiguous
+    // block of characters, and returning the block's length (zero at
+    // the end of the stream), then Parse reads blocks instead of single
+    // characters and feeds them to FeedCharacters.  Otherwise, if Reader
+    // implements TryReadChar, a method taking a CharT pointer, storing the
+    // next character through it, and returning false instead of throwing
+    // EOFException at the end of the stream, then Parse uses it so that
+    // reaching the end of the stream doesn't throw.
     template <typename Reader>
     void Parse(Reader &reader) {
         assert(this);
         assert(&reader);
-        CharT c;
-        try {
-            while (!reader.IsEOF()) {
-                HandleParsedCharacter(reader.ReadChar());
-            }
-        } catch (EOFException e) {}
+        ParseReader(reader, decltype(TestReadBlock<Reader>(0))());
     }
 
     // Parse the specified stream and call FinishParsing.
@@ -118,39 +509,338 @@ public:
         FinishParsing();
     }
 
+    // Return true if the last character the parser parsed was an unescaped
+    // escape character (i.e., the next character will be escaped).
+    bool IsEscaping() const { assert(this); return Escaping; }
+
+    // Return true if the parser is in the middle of a record.
+    bool IsInRecord() const { assert(this); return InRecord; }
+
+    // Return true if the parser is skipping the rest of a record because
+    // Derived's ShouldSkipRecord method returned true.
+    bool IsSkipping() const { assert(this); return Skipping; }
+
+    // Return the index of the current field within its record.  This is
+    // only meaningful while the parser is in a record.
+    size_t GetFieldIndex() const { assert(this); return FieldIndex; }
+
     // Make the parser think it's at the beginning of a stream
     // of data.
     void Reset() {
         assert(this);
-        Escaping = InRecord = false;
+        Escaping = InRecord = Skipping = false;
+        FieldWanted = true;
+        FieldIndex = 0;
+        Stats.OnReset();
         AsDerived()->OnReset();
     }
 
+    // Return the parser's instrumentation policy instance.
+    Statistics &GetStatistics() { assert(this); return Stats; }
+    const Statistics &GetStatistics() const { assert(this); return Stats; }
+
+    DSVParserState GetState() const {
+        assert(this);
+        DSVParserState state = { Escaping, InRecord, Skipping, FieldWanted,
+          FieldIndex };
+        return state;
+    }
+
+    // Put the parser in the specified state without invoking any of
+    // Derived's methods.  Derived is responsible for its own state, such
+    // as the characters of a partially parsed field.
+    void SetState(const DSVParserState &state) {
+        assert(this);
+        Escaping = state.Escaping;
+        InRecord = state.InRecord;
+        Skipping = state.Skipping;
+        FieldWanted = state.FieldWanted;
+        FieldIndex = state.FieldIndex;
+    }
+
 private:
+    // These detect which of the field character hooks Derived defines.
+    // They're members so that they honor friendship with Derived and
+    // they're only used within member function bodies because Derived
+    // is incomplete when DSVParser<Derived> is instantiated.
+    template <typename T>
+    static auto TestOnFieldCharacter(int) -> decltype(
+      std::declval<T &>().OnFieldCharacter(std::declval<CharT>()),
+      std::true_type());
+    template <typename T>
+    static std::false_type TestOnFieldCharacter(...);
+
+    template <typename T>
+    static auto TestOnFieldChunk(int) -> decltype(
+      std::declval<T &>().OnFieldChunk(std::declval<const CharT *>(),
+        std::declval<const CharT *>()),
+      std::true_type());
+    template <typename T>
+    static std::false_type TestOnFieldChunk(...);
+
+    template <typename T>
+    static auto TestIsFieldWanted(int) -> decltype(
+      std::declval<T &>().IsFieldWanted(size_t()), std::true_type());
+    template <typename T>
+    static std::false_type TestIsFieldWanted(...);
+
+    template <typename T>
+    static auto TestShouldSkipRecord(int) -> decltype(
+      std::declval<T &>().ShouldSkipRecord(), std::true_type());
+    template <typename T>
+    static std::false_type TestShouldSkipRecord(...);
+
+    template <typename T>
+    static auto TestOnBufferEnd(int) -> decltype(
+      std::declval<T &>().OnBufferEnd(), std::true_type());
+    template <typename T>
+    static std::false_type TestOnBufferEnd(...);
+
+    template <typename R>
+    static auto TestReadBlock(int) -> decltype(
+      std::declval<R &>().ReadBlock(std::declval<const CharT **>()),
+      std::true_type());
+    template <typename R>
+    static std::false_type TestReadBlock(...);
+
+    template <typename R>
+    static auto TestTryReadChar(int) -> decltype(
+      std::declval<R &>().TryReadChar(std::declval<CharT *>()),
+      std::true_type());
+    template <typename R>
+    static std::false_type TestTryReadChar(...);
+
     Derived *AsDerived() { return static_cast<Derived *>(this); }
 
+    template <typename Reader>
+    void ParseReader(Reader &reader, std::true_type) {
+        assert(this);
+        assert(&reader);
+        const CharT *block;
+        size_t size;
+        while ((size = reader.ReadBlock(&block)) != 0) {
+            FeedCharacters(block, block + size);
+        }
+    }
+
+    template <typename Reader>
+    void ParseReader(Reader &reader, std::false_type) {
+        assert(this);
+        assert(&reader);
+        ParseCharacters(reader, decltype(TestTryReadChar<Reader>(0))());
+    }
+
+    template <typename Reader>
+    void ParseCharacters(Reader &reader, std::true_type) {
+        assert(this);
+        assert(&reader);
+        CharT c;
+        while (reader.TryReadChar(&c)) {
+            Stats.OnCharacter();
+            HandleParsedCharacter(c);
+        }
+    }
+
+    template <typename Reader>
+    void ParseCharacters(Reader &reader, std::false_type) {
+        assert(this);
+        assert(&reader);
+        try {
+            while (!reader.IsEOF()) {
+                auto c = reader.ReadChar();
+                Stats.OnCharacter();
+                HandleParsedCharacter(c);
+            }
+        } catch (const EOFException &e) {}
+    }
+
+    // These are the traits of the parser's delimiters.
+    template <typename D = Derived>
+    using DelimiterTraits = detail::DSVDelimiterTraits<CharT,
+      detail::StaticDSVDelimiterSource<CharT, Delimiters, D>>;
+
+    CharT GetSeparatorChar() {
+        return GetSeparatorChar(typename DelimiterTraits<>::IsRunTime());
+    }
+
+    CharT GetSeparatorChar(std::true_type) {
+        return AsDerived()->GetSeparator();
+    }
+
+    CharT GetSeparatorChar(std::false_type) {
+        return DelimiterTraits<>::GetSeparator(CharT());
+    }
+
+    CharT GetEscapeChar() {
+        return GetEscapeChar(typename DelimiterTraits<>::IsRunTime());
+    }
+
+    CharT GetEscapeChar(std::true_type) { return AsDerived()->GetEscape(); }
+
+    CharT GetEscapeChar(std::false_type) {
+        return DelimiterTraits<>::GetEscape(CharT());
+    }
+
+    const CharT *FindSpecial(const CharT *begin, const CharT *end,
+      CharT separator, CharT escape) {
+        return DelimiterTraits<>::FindSpecial(begin, end, separator, escape);
+    }
+
+    // Return a pointer to the first escape or newline in [begin, end).
+    const CharT *FindEscapeOrNewline(const CharT *begin, const CharT *end,
+      CharT escape) {
+        return DelimiterTraits<>::FindEscapeOrNewline(begin, end, escape);
+    }
+
+    void EndBuffer(std::true_type) { AsDerived()->OnBufferEnd(); }
+
+    void EndBuffer(std::false_type) {}
+
+    bool IsFieldWanted(std::true_type) {
+        return AsDerived()->IsFieldWanted(FieldIndex);
+    }
+
+    bool IsFieldWanted(std::false_type) { return true; }
+
+    bool ShouldSkipRecord(std::true_type) {
+        return AsDerived()->ShouldSkipRecord();
+    }
+
+    bool ShouldSkipRecord(std::false_type) { return false; }
+
+    void StartRecord() {
+        assert(this);
+        InRecord = true;
+        FieldIndex = 0;
+        AsDerived()->OnRecordStart();
+        StartField();
+    }
+
+    void StartField() {
+        assert(this);
+        FieldWanted = IsFieldWanted(decltype(TestIsFieldWanted<Derived>(0))());
+    }
+
+    void EndField() {
+        assert(this);
+        if (FieldWanted) {
+            Stats.OnFieldEnd();
+            AsDerived()->OnFieldEnd();
+            if (ShouldSkipRecord(
+              decltype(TestShouldSkipRecord<Derived>(0))())) {
+                Skipping = true;
+            }
+        }
+    }
+
+    void EndRecord() {
+        assert(this);
+        InRecord = false;
+        if (Skipping) {
+            Skipping = false;
+            Stats.OnRecordSkipped();
+        } else {
+            Stats.OnRecordEnd();
+            AsDerived()->OnRecordEnd();
+        }
+    }
+
+    // Skip characters in [begin, end) until the end of the record being
+    // skipped and return a pointer to the first one that wasn't skipped.
+    const CharT *SkipRecord(const CharT *begin, const CharT *end,
+      CharT escape) {
+        assert(this);
+        assert(Skipping);
+        while (begin != end) {
+            if (Escaping) {
+                Escaping = false;
+                ++begin;
+                continue;
+            }
+            auto special = FindEscapeOrNewline(begin, end, escape);
+            if (special == end) {
+                return end;
+            } else if (*special == '\n') {
+                Skipping = InRecord = false;
+                Stats.OnRecordSkipped();
+                return special + 1;
+            }
+            Escaping = true;
+            Stats.OnEscape();
+            begin = special + 1;
+        }
+        return begin;
+    }
+
+    void EmitCharacter(CharT c) {
+        Stats.OnFieldCharacters(1);
+        typedef decltype(TestOnFieldCharacter<Derived>(0)) HasCharacterHook;
+        typedef decltype(TestOnFieldChunk<Derived>(0)) HasChunkHook;
+        static_assert(HasCharacterHook::value || HasChunkHook::value,
+          "Derived must define OnFieldCharacter or OnFieldChunk");
+        EmitCharacter(c, HasCharacterHook());
+    }
+
+    void EmitCharacter(CharT c, std::true_type) {
+        AsDerived()->OnFieldCharacter(c);
+    }
+
+    void EmitCharacter(CharT c, std::false_type) {
+        AsDerived()->OnFieldChunk(&c, &c + 1);
+    }
+
+    void EmitChunk(const CharT *begin, const CharT *end) {
+        Stats.OnFieldCharacters(static_cast<size_t>(end - begin));
+        EmitChunk(begin, end, decltype(TestOnFieldChunk<Derived>(0))());
+    }
+
+    void EmitChunk(const CharT *begin, const CharT *end, std::true_type) {
+        AsDerived()->OnFieldChunk(begin, end);
+    }
+
+    void EmitChunk(const CharT *begin, const CharT *end, std::false_type) {
+        for (; begin != end; ++begin) {
+            AsDerived()->OnFieldCharacter(*begin);
+        }
+    }
+
     void HandleParsedCharacter(CharT c) {
         assert(this);
-        if (Escaping) {
-            AsDerived()->OnFieldCharacter(c);
+        if (Skipping) {
+            if (Escaping) {
+                Escaping = false;
+            } else if (c == GetEscapeChar()) {
+                Escaping = true;
+                Stats.OnEscape();
+            } else if (c == '\n') {
+                Skipping = InRecord = false;
+                Stats.OnRecordSkipped();
+            }
+        } else if (Escaping) {
+            if (FieldWanted) {
+                EmitCharacter(c);
+            }
             Escaping = false;
         } else {
             if (!InRecord && c != '\n') {
-                InRecord = true;
-                AsDerived()->OnRecordStart();
+                StartRecord();
             }
-            if (c == AsDerived()->GetSeparator()) {
-                AsDerived()->OnFieldEnd();
-            } else if (c == AsDerived()->GetEscape()) {
+            if (c == GetSeparatorChar()) {
+                EndField();
+                if (!Skipping) {
+                    ++FieldIndex;
+                    StartField();
+                }
+            } else if (c == GetEscapeChar()) {
                 Escaping = true;
+                Stats.OnEscape();
             } else if (c == '\n') {
                 if (InRecord) {
-                    AsDerived()->OnFieldEnd();
-                    InRecord = false;
-                    AsDerived()->OnRecordEnd();
+                    EndField();
+                    EndRecord();
                 }
-            } else {
-                AsDerived()->OnFieldCharacter(c);
+            } else if (FieldWanted) {
+                EmitCharacter(c);
             }
         }
     }
@@ -160,6 +850,10 @@ private:
         assert(&that);
         Escaping = that.Escaping;
         InRecord = that.InRecord;
+        Skipping = that.Skipping;
+        FieldWanted = that.FieldWanted;
+        FieldIndex = that.FieldIndex;
+        Stats = that.Stats;
     }
 
     // true if the parser just parsed an unescaped escape character
@@ -168,24 +862,64 @@ private:
     // true if the parser is in the middle of a record
     bool InRecord;
 
+    // true if the parser is skipping the rest of the current record
+    bool Skipping;
+
+    // true if Derived wants the current field's characters
+    bool FieldWanted;
+
+    // This is empty by default, so it only occupies padding.
+    Statistics Stats;
+
+    // the index of the current field within its record
+    size_t FieldIndex;
+
 };    // class DSVParser
 
 // This class provides the methods required by DSVParser as pure virtual
 // functions.  Derive from this class if you need run-time polymorphism.
+// OnFieldChunk is optional: By default, it passes each character in the
+// chunk to OnFieldCharacter.  Override it to handle runs in bulk.
+// IsFieldWanted and ShouldSkipRecord are optional, too: By default, all
+// fields are wanted and no records are skipped.
 template <typename _CharT = char>
 class DynamicDSVParser : public DSVParser<DynamicDSVParser<_CharT>, _CharT> {
 
 public:
     virtual void OnRecordStart() = 0;
     virtual void OnFieldCharacter(_CharT c) = 0;
+    virtual void OnFieldChunk(const _CharT *begin, const _CharT *end) {
+        assert(this);
+        for (; begin != end; ++begin) {
+            OnFieldCharacter(*begin);
+        }
+    }
     virtual void OnFieldEnd() = 0;
     virtual void OnRecordEnd() = 0;
     virtual void OnReset() = 0;
+    virtual bool IsFieldWanted(size_t) { assert(this); return true; }
+    virtual bool ShouldSkipRecord() { assert(this); return false; }
     virtual _CharT GetEscape() const = 0;
     virtual _CharT GetSeparator() const = 0;
 
 };    // class DynamicDSVParser
 
+// This is a policy class for DSVParser's Delimiters parameter that fixes
+// the separator and escape characters at compile time.
+template <typename _CharT, _CharT _Separator, _CharT _Escape>
+class DSVDelimiters {
+
+public:
+    static const _CharT Separator = _Separator;
+    static const _CharT Escape = _Escape;
+
+};    // class DSVDelimiters
+
+// This is a DSVDelimiters for the escape and separator characters used by
+// UnixDSVParser.
+template <typename _CharT = char>
+using UnixDSVDelimiters = DSVDelimiters<_CharT, ':', '\\'>;
+
 // This class provides GetEscape and GetSeparator methods that return
 // '\\' and ':', respectively.  These are the escape and separator
 // characters that are most commonly used in UNIX DSV files.
@@ -201,4 +935,223 @@ public:
 
 };    // class UnixDSVParser
 
+// This describes a field whose characters are stored elsewhere, such as
+// in an Arena.  The characters aren't null-terminated.
+template <typename _CharT = char>
+struct DSVField {
+    const _CharT *Data;
+    size_t Size;
+};
+
+// This class is a DSVParser that copies each record's unescaped fields into
+// an Arena and passes them to Derived in one call.  Derived must define
+// a method called OnRecord taking a const DSVField<_CharT> pointer to the
+// record's fields and the number of fields.  The fields and the array
+// describing them remain valid until the arena is reset, so Derived can
+// keep whole batches of records and reset the arena between batches: The
+// arena's blocks are reused, so a batch only costs a handful of large
+// allocations no matter how many fields it has.
+//
+// Derived must also define GetSeparator and GetEscape unless the delimiters
+// are fixed at compile time (see DSVParser).  It must not define the other
+// DSVParser methods.  Call FinishParsing before destroying a
+// DSVFieldCollector: Its destructor discards incomplete records.
+// Delimiters and Statistics are passed to DSVParser.
+template <typename Derived, typename _CharT = char,
+  typename Delimiters = void, typename Statistics = NoDSVStatistics>
+class DSVFieldCollector
+  : public DSVParser<Derived, _CharT, Delimiters, Statistics> {
+
+public:
+    typedef _CharT CharT;
+
+    DSVFieldCollector() = delete;
+    DSVFieldCollector(Arena *arena) : Storage(arena) {
+        assert(this);
+        assert(arena);
+        ResetField();
+    }
+
+    ~DSVFieldCollector() {
+        assert(this);
+        this->Reset();
+    }
+
+    Arena *GetArena() const { assert(this); return Storage; }
+
+    // Make the collector allocate from a different arena.  Don't call this
+    // while the collector is in the middle of a record.
+    void SetArena(Arena *arena) {
+        assert(this);
+        assert(arena);
+        assert(!this->IsInRecord());
+        Storage = arena;
+    }
+
+    void OnRecordStart() {
+        assert(this);
+        Fields.clear();
+        ResetField();
+    }
+
+    void OnFieldChunk(const CharT *begin, const CharT *end) {
+        assert(this);
+        auto size = static_cast<size_t>(end - begin);
+        Field.Data = static_cast<CharT *>(Storage->Reallocate(Field.Data,
+          Field.Size * sizeof(CharT), (Field.Size + size) * sizeof(CharT),
+          alignof(CharT)));
+        std::copy(begin, end, Field.Data + Field.Size);
+        Field.Size += size;
+    }
+
+    void OnFieldEnd() {
+        assert(this);
+        DSVField<CharT> field = { Field.Data, Field.Size };
+        Fields.push_back(field);
+        ResetField();
+    }
+
+    void OnRecordEnd() {
+        assert(this);
+        auto fields = Storage->AllocateArray<DSVField<CharT>>(Fields.size());
+        std::copy(Fields.begin(), Fields.end(), fields);
+        static_cast<Derived *>(this)->OnRecord(
+          static_cast<const DSVField<CharT> *>(fields), Fields.size());
+    }
+
+    void OnReset() {
+        assert(this);
+        Fields.clear();
+        ResetField();
+    }
+
+private:
+    void ResetField() {
+        assert(this);
+        Field.Data = nullptr;
+        Field.Size = 0;
+    }
+
+    Arena *Storage;
+
+    // the fields of the record being parsed
+    std::vector<DSVField<CharT>> Fields;
+
+    // the field being parsed; its characters are the most recent
+    // allocation from the arena, so they usually grow in place
+    struct {
+        CharT *Data;
+        size_t Size;
+    } Field;
+
+};    // class DSVFieldCollector
+
+// This class is a DSVParser for pushing arbitrary pieces of input, such as
+// network packets, with FeedBuffer or FeedCharacters.  It passes each
+// unescaped field to Derived as a DSVField.  A field that lies entirely
+// within one FeedCharacters range and contains no escape characters is
+// passed as a pointer into that range without being copied.  Other fields
+// (those that straddle ranges, contain escapes, or are fed a character at
+// a time) are gathered in a carry-over buffer that is reused for every
+// field, so only the straddling part of the input is ever copied.
+//
+// Derived must define OnRecordStart and OnRecordEnd (see DSVParser) and
+// a method called OnField taking a const DSVField<_CharT> reference,
+// which is invoked when each field is complete.  The field's characters
+// are only valid for the duration of the call.  Derived must also define
+// GetSeparator and GetEscape unless the delimiters are fixed at compile
+// time.  It may define IsFieldWanted and ShouldSkipRecord but must not
+// define the other DSVParser methods.  Delimiters and Statistics are
+// passed to DSVParser.
+template <typename Derived, typename _CharT = char,
+  typename Delimiters = void, typename Statistics = NoDSVStatistics>
+class DSVSpanParser
+  : public DSVParser<Derived, _CharT, Delimiters, Statistics> {
+
+public:
+    typedef _CharT CharT;
+
+    DSVSpanParser() : InCarry(false) {
+        assert(this);
+        ResetField();
+    }
+
+    ~DSVSpanParser() {
+        assert(this);
+        this->Reset();
+    }
+
+    void OnFieldCharacter(CharT c) {
+        assert(this);
+        Carry();
+        CarryBuffer.push_back(c);
+    }
+
+    void OnFieldChunk(const CharT *begin, const CharT *end) {
+        assert(this);
+        if (!InCarry && !Field.Data) {
+            Field.Data = begin;
+            Field.Size = static_cast<size_t>(end - begin);
+            return;
+        }
+        Carry();
+        CarryBuffer.insert(CarryBuffer.end(), begin, end);
+    }
+
+    void OnFieldEnd() {
+        assert(this);
+        if (InCarry) {
+            Field.Data = CarryBuffer.data();
+            Field.Size = CarryBuffer.size();
+        }
+        static_cast<Derived *>(this)->OnField(
+          static_cast<const DSVField<CharT> &>(Field));
+        ResetField();
+    }
+
+    // The current field's characters won't be valid after FeedCharacters
+    // returns, so copy them.
+    void OnBufferEnd() {
+        assert(this);
+        if (Field.Data) {
+            Carry();
+        }
+    }
+
+    void OnReset() {
+        assert(this);
+        ResetField();
+    }
+
+private:
+    // Move the current field's characters into the carry-over buffer if
+    // they aren't there already.
+    void Carry() {
+        assert(this);
+        if (!InCarry) {
+            if (Field.Data) {
+                CarryBuffer.assign(Field.Data, Field.Data + Field.Size);
+            }
+            InCarry = true;
+        }
+    }
+
+    void ResetField() {
+        assert(this);
+        Field.Data = nullptr;
+        Field.Size = 0;
+        CarryBuffer.clear();
+        InCarry = false;
+    }
+
+    // the field being parsed; if InCarry is false, it points into the
+    // current FeedCharacters range (or is null if it's empty so far)
+    DSVField<CharT> Field;
+
+    // the characters of the field being parsed if InCarry is true
+    std::vector<CharT> CarryBuffer;
+    bool InCarry;
+
+};    // class DSVSpanParser
+
 }    // namespace PlainText
@@ -0,0 +1,254 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines classes for delivering parsed DSV records in
+// batches of thousands rather than one at a time, so that the cost of
+// calling handlers (especially virtual ones) is spread over many records
+// and handlers can process whole columns of records in tight loops.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include <Arena.h>
+#include <DSV.h>
+
+namespace libpt {
+
+// Instances of this class hold a batch of records.  The fields of all of
+// the records are in one array, in order, and record i's fields are
+// elements [offsets[i], offsets[i + 1]) of it, where offsets is the array
+// returned by GetRecordOffsets.  Fields' characters are stored in an
+// arena owned by the batch.  Clear empties a batch while keeping its
+// memory, so reusing a batch allocates nothing once it has grown to fit
+// its records.  Batches are movable but not copyable.
+template <typename _CharT = char>
+class DSVRecordBatch {
+
+public:
+    typedef _CharT CharT;
+
+    DSVRecordBatch(size_t block_size = Arena::DefaultBlockSize)
+      : Storage(block_size) {
+        assert(this);
+        Offsets.push_back(0);
+        ResetField();
+    }
+
+    DSVRecordBatch(const DSVRecordBatch &that) = delete;
+    DSVRecordBatch &operator=(const DSVRecordBatch &that) = delete;
+    DSVRecordBatch(DSVRecordBatch &&that) = default;
+    DSVRecordBatch &operator=(DSVRecordBatch &&that) = default;
+
+    size_t GetRecordCount() const {
+        assert(this);
+        return Offsets.size() - 1;
+    }
+
+    // Return the number of fields in all of the batch's records.
+    size_t GetFieldCount() const { assert(this); return Offsets.back(); }
+
+    bool IsEmpty() const { assert(this); return Offsets.size() == 1; }
+
+    // Return the fields of all of the batch's records.
+    const DSVField<CharT> *GetFields() const {
+        assert(this);
+        return Fields.data();
+    }
+
+    // Return the array of GetRecordCount() + 1 field offsets described
+    // above.
+    const size_t *GetRecordOffsets() const {
+        assert(this);
+        return Offsets.data();
+    }
+
+    // Return the fields of the record at the specified index and store the
+    // number of fields in *field_count.
+    const DSVField<CharT> *GetRecord(size_t index, size_t *field_count)
+      const {
+        assert(this);
+        assert(index < GetRecordCount());
+        assert(field_count);
+        *field_count = Offsets[index + 1] - Offsets[index];
+        return Fields.data() + Offsets[index];
+    }
+
+    // Append characters to the field being built.
+    void AddCharacters(const CharT *begin, const CharT *end) {
+        assert(this);
+        auto size = static_cast<size_t>(end - begin);
+        Field.Data = static_cast<CharT *>(Storage.Reallocate(Field.Data,
+          Field.Size * sizeof(CharT), (Field.Size + size) * sizeof(CharT),
+          alignof(CharT)));
+        std::copy(begin, end, Field.Data + Field.Size);
+        Field.Size += size;
+    }
+
+    // Finish the field being built and add it to the record being built.
+    void EndField() {
+        assert(this);
+        DSVField<CharT> field = { Field.Data, Field.Size };
+        Fields.push_back(field);
+        ResetField();
+    }
+
+    // Finish the record being built and add it to the batch.
+    void EndRecord() {
+        assert(this);
+        Offsets.push_back(Fields.size());
+    }
+
+    // Discard the fields of the record being built.  Their characters
+    // stay in the arena until the batch is cleared.
+    void DiscardRecord() {
+        assert(this);
+        Fields.resize(Offsets.back());
+        ResetField();
+    }
+
+    // Remove all of the batch's records, invalidating their fields.
+    void Clear() {
+        assert(this);
+        Storage.Reset();
+        Fields.clear();
+        Offsets.resize(1);
+        ResetField();
+    }
+
+private:
+    void ResetField() {
+        assert(this);
+        Field.Data = nullptr;
+        Field.Size = 0;
+    }
+
+    Arena Storage;
+    std::vector<DSVField<CharT>> Fields;
+    std::vector<size_t> Offsets;
+
+    // the field being built; its characters are the most recent
+    // allocation from the arena, so they usually grow in place
+    struct {
+        CharT *Data;
+        size_t Size;
+    } Field;
+
+};  // class DSVRecordBatch
+
+// This class is a DSVParser that gathers records into a DSVRecordBatch and
+// passes the batch to Derived's OnBatch method, which takes a const
+// DSVRecordBatch<_CharT> reference, whenever it holds batch_size records.
+// The batch is cleared and reused after OnBatch returns, so its fields are
+// only valid during the call.  Call FinishParsing and then Flush at the
+// end of the input to deliver the last, partial batch.
+//
+// Derived must also define GetSeparator and GetEscape unless the delimiters
+// are fixed at compile time (see DSVParser).  It may define IsFieldWanted
+// and ShouldSkipRecord but must not define the other DSVParser methods.
+// Unwanted fields aren't stored, so records' fields are then the wanted
+// ones.  Delimiters and Statistics are passed to DSVParser.
+template <typename Derived, typename _CharT = char,
+  typename Delimiters = void, typename Statistics = NoDSVStatistics>
+class DSVBatchCollector
+  : public DSVParser<Derived, _CharT, Delimiters, Statistics> {
+
+public:
+    typedef _CharT CharT;
+
+    static const size_t DefaultBatchSize = 4096;
+
+    DSVBatchCollector(size_t batch_size = DefaultBatchSize)
+      : BatchSize(batch_size) {
+        assert(this);
+        assert(batch_size > 0);
+    }
+
+    ~DSVBatchCollector() {
+        assert(this);
+        this->Reset();
+    }
+
+    size_t GetBatchSize() const { assert(this); return BatchSize; }
+
+    // Pass the records gathered so far to OnBatch, if there are any.
+    void Flush() {
+        assert(this);
+        if (!Batch.IsEmpty()) {
+            static_cast<Derived *>(this)->OnBatch(
+              static_cast<const DSVRecordBatch<CharT> &>(Batch));
+            Batch.Clear();
+        }
+    }
+
+    void OnRecordStart() {
+        assert(this);
+        Batch.DiscardRecord();
+    }
+
+    void OnFieldChunk(const CharT *begin, const CharT *end) {
+        assert(this);
+        Batch.AddCharacters(begin, end);
+    }
+
+    void OnFieldEnd() {
+        assert(this);
+        Batch.EndField();
+    }
+
+    void OnRecordEnd() {
+        assert(this);
+        Batch.EndRecord();
+        if (Batch.GetRecordCount() >= BatchSize) {
+            Flush();
+        }
+    }
+
+    // Resetting discards the incomplete record but keeps complete ones for
+    // the next Flush.
+    void OnReset() {
+        assert(this);
+        Batch.DiscardRecord();
+    }
+
+private:
+    size_t BatchSize;
+    DSVRecordBatch<CharT> Batch;
+
+};  // class DSVBatchCollector
+
+// This class provides DSVBatchCollector's OnBatch and the delimiter
+// methods as pure virtual functions.  Derive from this class if you need
+// run-time polymorphism: There's one virtual call per batch rather than
+// several per field, as with DynamicDSVParser.
+template <typename _CharT = char>
+class DynamicDSVBatchCollector
+  : public DSVBatchCollector<DynamicDSVBatchCollector<_CharT>, _CharT> {
+
+public:
+    DynamicDSVBatchCollector(size_t batch_size =
+      DSVBatchCollector<DynamicDSVBatchCollector<_CharT>, _CharT>::
+        DefaultBatchSize)
+      : DSVBatchCollector<DynamicDSVBatchCollector<_CharT>, _CharT>(
+          batch_size) {
+        assert(this);
+    }
+
+    virtual ~DynamicDSVBatchCollector() {}
+
+    virtual void OnBatch(const DSVRecordBatch<_CharT> &batch) = 0;
+    virtual _CharT GetEscape() const = 0;
+    virtual _CharT GetSeparator() const = 0;
+
+};  // class DynamicDSVBatchCollector
+
+}   // namespace libpt
@@ -0,0 +1,293 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines templates for parsing DSV records directly into
+// structs whose members are bound to fields at compile time.  For
+// example, given
+//
+//     struct Account {
+//         DSVField<char> Name;
+//         uint32_t Uid;
+//         uint32_t Gid;
+//         std::string Home;
+//     };
+//
+//     typedef DSVSchema<Account,
+//       DSVBoundField<Account, DSVField<char>, &Account::Name>,
+//       DSVIgnoredField,
+//       DSVBoundField<Account, uint32_t, &Account::Uid>,
+//       DSVBoundField<Account, uint32_t, &Account::Gid>,
+//       DSVIgnoredField,
+//       DSVBoundField<Account, std::string, &Account::Home>> AccountSchema;
+//
+// a DSVRecordBinder<Derived, AccountSchema, char, UnixDSVDelimiters<>>
+// parses /etc/passwd into Accounts and passes each one to Derived's
+// OnRecord method.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <DSV.h>
+#include <StringToNumber.h>
+
+namespace libpt {
+
+// This binds a field to Record's member Member, which is a T.  T may be
+// an arithmetic type, DSVField<CharT>, or std::basic_string<CharT>.
+template <typename Record, typename T, T Record::*Member>
+struct DSVBoundField {
+    typedef T Type;
+
+    static T &Get(Record &record) { return record.*Member; }
+};
+
+// This is a placeholder for a field that isn't bound to anything.  Its
+// characters are never copied.
+struct DSVIgnoredField {};
+
+// This describes a record: field i is loaded as specified by the ith
+// element of Fields, which must be a DSVBoundField for Record or a
+// DSVIgnoredField.  Fields beyond the last one are ignored.
+template <typename Record, typename... Fields>
+struct DSVSchema {
+    typedef Record RecordType;
+
+    static const size_t FieldCount = sizeof...(Fields);
+};
+
+template <typename Derived, typename Schema, typename _CharT = char,
+  typename Delimiters = void>
+class DSVRecordBinder;
+
+// This class is a DSVParser that parses each record into a Record (see
+// DSVSchema above) and passes it to Derived's OnRecord method, which takes
+// a const Record reference.  Only bound fields' characters are gathered,
+// and they're gathered into a buffer that's reused for every record, so
+// parsing allocates nothing once the buffer has grown.  Each field is
+// stored by a function chosen for its type at compile time and found in
+// a table indexed by the field's index.
+//
+// Arithmetic members are converted as by StringsToNumbers (see
+// StringToNumber.h): in base 10, and only if the whole field is a number
+// in range.  DSVField members point into the buffer, so they're only valid
+// during OnRecord.  std::basic_string members are assigned, so they reuse
+// their capacity from record to record.  The same Record is reused for
+// every record.
+//
+// A field is erroneous if it's missing or isn't a valid number.  Missing
+// fields are zero or empty, and so are erroneous numbers.
+// GetFieldErrors, during OnRecord, returns a mask whose bit i is set if
+// and only if field i is erroneous, so schemas have at most 64 fields.
+//
+// Derived must define OnRecord and, unless the delimiters are fixed at
+// compile time, GetSeparator and GetEscape (see DSVParser).  It may define
+// ShouldSkipRecord but must not define the other DSVParser methods.
+// Delimiters is passed to DSVParser.  Numeric fields require char input.
+template <typename Derived, typename Record, typename... Fields,
+  typename _CharT, typename Delimiters>
+class DSVRecordBinder<Derived, DSVSchema<Record, Fields...>, _CharT,
+  Delimiters> : public DSVParser<Derived, _CharT, Delimiters> {
+
+public:
+    typedef _CharT CharT;
+    typedef DSVSchema<Record, Fields...> Schema;
+
+    static const size_t FieldCount = Schema::FieldCount;
+
+    static_assert(FieldCount > 0, "schemas must have fields");
+    static_assert(FieldCount <= 64, "schemas have at most 64 fields");
+
+    DSVRecordBinder() : FieldStart(0), Errors(0) {
+        assert(this);
+        std::fill(Starts, Starts + FieldCount, 0);
+        std::fill(Sizes, Sizes + FieldCount, 0);
+    }
+
+    ~DSVRecordBinder() {
+        assert(this);
+        this->Reset();
+    }
+
+    // Return the mask of erroneous fields in the current record.
+    uint64_t GetFieldErrors() const { assert(this); return Errors; }
+
+    bool IsFieldWanted(size_t index) {
+        assert(this);
+        static const bool bound[] = {
+          !std::is_same<Fields, DSVIgnoredField>::value... };
+        return index < FieldCount && bound[index];
+    }
+
+    void OnRecordStart() {
+        assert(this);
+        Characters.clear();
+        FieldStart = 0;
+        Errors = 0;
+    }
+
+    void OnFieldChunk(const CharT *begin, const CharT *end) {
+        assert(this);
+        Characters.insert(Characters.end(), begin, end);
+    }
+
+    void OnFieldEnd() {
+        assert(this);
+        typedef void (DSVRecordBinder::*Store)(size_t);
+        static const Store stores[] = {
+          &DSVRecordBinder::template StoreField<Fields>... };
+        // Calling through stores[index] directly crashes GCC 12's C++17
+        // -fsanitize=undefined builds, so load the pointer first.
+        auto index = this->GetFieldIndex();
+        auto store = stores[index];
+        (this->*store)(index);
+    }
+
+    void OnRecordEnd() {
+        assert(this);
+        typedef void (DSVRecordBinder::*Finish)(size_t, bool);
+        static const Finish finishes[] = {
+          &DSVRecordBinder::template FinishField<Fields>... };
+        auto last = this->GetFieldIndex();
+        for (size_t index = 0; index < FieldCount; ++index) {
+            auto finish = finishes[index];
+            (this->*finish)(index, index <= last);
+        }
+        static_cast<Derived *>(this)->OnRecord(
+          static_cast<const Record &>(Current));
+    }
+
+    void OnReset() {
+        assert(this);
+        Characters.clear();
+        FieldStart = 0;
+        Errors = 0;
+    }
+
+private:
+    const CharT *GetFieldBegin() const {
+        return Characters.data() + FieldStart;
+    }
+
+    const CharT *GetFieldEnd() const {
+        return Characters.data() + Characters.size();
+    }
+
+    // Discard the field's characters.
+    void DropField() { Characters.resize(FieldStart); }
+
+    // Ignored fields have no storage, but they have entries in the tables
+    // above so that fields' indices index them.
+    template <typename Field>
+    void StoreField(size_t index) {
+        StoreBound<Field>(index, std::is_same<Field, DSVIgnoredField>());
+    }
+
+    template <typename Field>
+    void StoreBound(size_t index, std::false_type) {
+        StoreValue(index, Field::Get(Current));
+    }
+
+    template <typename Field>
+    void StoreBound(size_t, std::true_type) {}
+
+    template <typename T>
+    void StoreValue(size_t index, T &value) {
+        static_assert(std::is_arithmetic<T>::value,
+          "fields must be numbers, DSVFields, or strings");
+        static_assert(std::is_same<CharT, char>::value,
+          "numeric fields require char input");
+        auto saved_errno = errno;
+        if (!detail::FieldToNumber(GetFieldBegin(), GetFieldEnd(), &value,
+          std::is_floating_point<T>())) {
+            value = T();
+            Errors |= UINT64_C(1) << index;
+        }
+        errno = saved_errno;
+        DropField();
+    }
+
+    // The field's characters stay in the buffer, which can move, so its
+    // location is recorded until the record is finished.
+    void StoreValue(size_t index, DSVField<CharT> &) {
+        Starts[index] = FieldStart;
+        Sizes[index] = Characters.size() - FieldStart;
+        FieldStart = Characters.size();
+    }
+
+    void StoreValue(size_t, std::basic_string<CharT> &value) {
+        value.assign(GetFieldBegin(), GetFieldEnd());
+        DropField();
+    }
+
+    template <typename Field>
+    void FinishField(size_t index, bool present) {
+        FinishBound<Field>(index, present,
+          std::is_same<Field, DSVIgnoredField>());
+    }
+
+    template <typename Field>
+    void FinishBound(size_t index, bool present, std::false_type) {
+        FinishValue(index, present, Field::Get(Current));
+    }
+
+    template <typename Field>
+    void FinishBound(size_t, bool, std::true_type) {}
+
+    template <typename T>
+    void FinishValue(size_t index, bool present, T &value) {
+        if (!present) {
+            value = T();
+            Errors |= UINT64_C(1) << index;
+        }
+    }
+
+    void FinishValue(size_t index, bool present,
+      std::basic_string<CharT> &value) {
+        if (!present) {
+            value.clear();
+            Errors |= UINT64_C(1) << index;
+        }
+    }
+
+    void FinishValue(size_t index, bool present, DSVField<CharT> &value) {
+        if (present) {
+            value.Data = Characters.data() + Starts[index];
+            value.Size = Sizes[index];
+        } else {
+            value.Data = nullptr;
+            value.Size = 0;
+            Errors |= UINT64_C(1) << index;
+        }
+    }
+
+    Record Current;
+
+    // the characters of the current record's bound fields
+    std::vector<CharT> Characters;
+
+    // the index in Characters of the current field's first character
+    size_t FieldStart;
+
+    // the locations of DSVField members' characters in Characters
+    size_t Starts[FieldCount];
+    size_t Sizes[FieldCount];
+
+    uint64_t Errors;
+
+};  // class DSVRecordBinder
+
+}   // namespace libpt
@@ -0,0 +1,207 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for saving DSV parsers' progress through
+// their inputs so that parsing can resume where it stopped after a
+// program restarts.  It requires POSIX.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <unistd.h>
+#include <DSV.h>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// Instances of this class hold a DSVParser's state (see DSVParserState),
+// the offset of the next character of the parser's input, and the
+// parser's statistics if its Statistics policy defines GetCounters and
+// SetCounters (as DSVStatistics does).  They can be saved to and loaded
+// from files.
+//
+// Derived's OnBufferEnd method (see DSVParser) is a good place to capture
+// checkpoints: The offset is then the number of characters parsed so far,
+// and DSVStatistics::GetCharacters returns it.  To resume, load the
+// checkpoint, Restore it into a new parser, Seek the reader to the offset
+// (see DescriptorReader, FileReader, and MappedFileReader), and parse.
+//
+// If a checkpoint is captured in the middle of a record (see
+// DSVParser::IsInRecord), Derived's own state, such as the record's
+// fields so far, must be saved and restored with it.  Checkpoints
+// captured between records need nothing else.
+class DSVCheckpoint {
+
+public:
+    static const size_t MaxCounters = 16;
+
+    DSVCheckpoint() : Offset(0), CounterCount(0) {
+        assert(this);
+        State.Escaping = State.InRecord = State.Skipping = false;
+        State.FieldWanted = true;
+        State.FieldIndex = 0;
+        std::fill(Counters, Counters + MaxCounters, 0);
+    }
+
+    // Record parser's state and statistics and offset, the offset of the
+    // next character that parser will parse.
+    template <typename Parser>
+    void Capture(const Parser &parser, uint64_t offset) {
+        assert(this);
+        assert(&parser);
+        Offset = offset;
+        State = parser.GetState();
+        CaptureCounters(parser.GetStatistics(), decltype(TestCounters<
+          typename std::decay<decltype(parser.GetStatistics())>::type>(0))());
+    }
+
+    // Reset parser and then put it in the checkpoint's state.  Its
+    // statistics are restored if the checkpoint has them and its
+    // Statistics policy has the same number of counters.  Restore
+    // Derived's state afterward: Resetting the parser resets it.
+    template <typename Parser>
+    void Restore(Parser &parser) const {
+        assert(this);
+        assert(&parser);
+        parser.Reset();
+        parser.SetState(State);
+        RestoreCounters(parser.GetStatistics(), decltype(TestCounters<
+          typename std::decay<decltype(parser.GetStatistics())>::type>(0))());
+    }
+
+    uint64_t GetOffset() const { assert(this); return Offset; }
+    const DSVParserState &GetState() const { assert(this); return State; }
+
+    // Return the number of statistics counters in the checkpoint, which
+    // is zero if the parser had none.
+    size_t GetCounterCount() const { assert(this); return CounterCount; }
+    const uint64_t *GetCounters() const { assert(this); return Counters; }
+
+    // Write the checkpoint to the file at the specified path in the host's
+    // byte order.  It's written to a temporary file (path with ".tmp"
+    // appended), which is synced to disk and then replaces the file, so an
+    // interrupted save (even by a crash or power loss) leaves the previous
+    // checkpoint intact.  This throws FileOpenException if
+    // the temporary file can't be created and IOException if it can't be
+    // written or renamed.
+    void Save(const char *path) const {
+        assert(this);
+        assert(path);
+        auto temporary = std::string(path) + ".tmp";
+        auto file = fopen(temporary.c_str(), "wb");
+        if (!file) {
+            throw FileOpenException(path, errno);
+        }
+        uint64_t flags = (State.Escaping ? 1 : 0) | (State.InRecord ? 2 : 0) |
+          (State.Skipping ? 4 : 0) | (State.FieldWanted ? 8 : 0);
+        uint64_t header[] = { Magic, Offset, flags, State.FieldIndex,
+          CounterCount };
+        auto written = fwrite(header, sizeof(header), 1, file) == 1 &&
+          fwrite(Counters, sizeof(uint64_t), CounterCount, file) ==
+          CounterCount && fflush(file) == 0 && fsync(fileno(file)) == 0;
+        auto error = errno;
+        if (fclose(file) != 0 && written) {
+            written = false;
+            error = errno;
+        }
+        if (written && rename(temporary.c_str(), path) != 0) {
+            written = false;
+            error = errno;
+        }
+        if (!written) {
+            remove(temporary.c_str());
+            throw IOException(path, error);
+        }
+    }
+
+    // Replace the checkpoint with the one in the file at the specified
+    // path.  This throws FileOpenException if the file can't be opened and
+    // IOException if it can't be read or isn't a checkpoint (in which case
+    // the errno value is EINVAL).
+    void Load(const char *path) {
+        assert(this);
+        assert(path);
+        auto file = fopen(path, "rb");
+        if (!file) {
+            throw FileOpenException(path, errno);
+        }
+        uint64_t header[5];
+        uint64_t counters[MaxCounters];
+        auto error = EINVAL;
+        if (fread(header, sizeof(header), 1, file) == 1 &&
+          header[0] == Magic && header[4] <= MaxCounters &&
+          fread(counters, sizeof(uint64_t), header[4], file) == header[4]) {
+            error = 0;
+        }
+        if (ferror(file)) {
+            error = errno;
+        }
+        fclose(file);
+        if (error != 0) {
+            throw IOException(path, error);
+        }
+        Offset = header[1];
+        State.Escaping = (header[2] & 1) != 0;
+        State.InRecord = (header[2] & 2) != 0;
+        State.Skipping = (header[2] & 4) != 0;
+        State.FieldWanted = (header[2] & 8) != 0;
+        State.FieldIndex = static_cast<size_t>(header[3]);
+        CounterCount = static_cast<size_t>(header[4]);
+        std::fill(Counters, Counters + MaxCounters, 0);
+        std::copy(counters, counters + CounterCount, Counters);
+    }
+
+private:
+    // "libptCKP" in little-endian byte order
+    static const uint64_t Magic = UINT64_C(0x504B43747062696C);
+
+    template <typename S>
+    static auto TestCounters(int) -> decltype(
+      std::declval<const S &>().GetCounters(std::declval<uint64_t *>()),
+      std::declval<S &>().SetCounters(std::declval<const uint64_t *>()),
+      std::integral_constant<bool, (S::CounterCount <= MaxCounters)>());
+    template <typename S>
+    static std::false_type TestCounters(...);
+
+    template <typename S>
+    void CaptureCounters(const S &statistics, std::true_type) {
+        CounterCount = S::CounterCount;
+        statistics.GetCounters(Counters);
+    }
+
+    template <typename S>
+    void CaptureCounters(const S &, std::false_type) { CounterCount = 0; }
+
+    template <typename S>
+    void RestoreCounters(S &statistics, std::true_type) const {
+        if (CounterCount == S::CounterCount) {
+            statistics.SetCounters(Counters);
+        }
+    }
+
+    template <typename S>
+    void RestoreCounters(S &, std::false_type) const {}
+
+    uint64_t Offset;
+    DSVParserState State;
+    size_t CounterCount;
+    uint64_t Counters[MaxCounters];
+
+};  // class DSVCheckpoint
+
+}   // namespace libpt
@@ -0,0 +1,337 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a DSV parser that loads selected fields into
+// per-column contiguous buffers (i.e., a struct of arrays) instead of
+// building row objects.
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <DSV.h>
+#include <StringToNumber.h>
+
+namespace libpt {
+
+// This is the base class of DSVColumnLoaders' columns.
+class DSVColumn {
+
+public:
+    virtual ~DSVColumn() {}
+
+    // Return the number of values in the column.
+    virtual size_t GetCount() const = 0;
+
+    // Remove all of the column's values.
+    virtual void Clear() = 0;
+
+protected:
+    template <typename C, typename D> friend class DSVColumnLoader;
+
+    // Finish any values whose conversion was deferred.
+    virtual void Flush() {}
+
+};  // class DSVColumn
+
+// Instances of this class hold string columns.  All of the column's
+// unescaped characters are stored back to back; value i occupies
+// [GetOffsets()[i], GetOffsets()[i + 1]) within GetBytes().  The values
+// aren't null-terminated.
+template <typename _CharT = char>
+class DSVStringColumn : public DSVColumn {
+
+public:
+    typedef _CharT CharT;
+
+    DSVStringColumn() : Offsets(1, 0) {}
+
+    size_t GetCount() const { assert(this); return Offsets.size() - 1; }
+
+    const CharT *GetData(size_t index) const {
+        assert(this);
+        assert(index < GetCount());
+        return Bytes.data() + Offsets[index];
+    }
+
+    size_t GetSize(size_t index) const {
+        assert(this);
+        assert(index < GetCount());
+        return Offsets[index + 1] - Offsets[index];
+    }
+
+    const std::vector<CharT> &GetBytes() const { assert(this); return Bytes; }
+    const std::vector<size_t> &GetOffsets() const {
+        assert(this);
+        return Offsets;
+    }
+
+    void Clear() {
+        assert(this);
+        Bytes.clear();
+        Offsets.assign(1, 0);
+    }
+
+private:
+    template <typename C, typename D> friend class DSVColumnLoader;
+
+    std::vector<CharT> Bytes;
+    std::vector<size_t> Offsets;
+
+};  // class DSVStringColumn
+
+// Instances of this class hold numeric columns of Ts.  Fields are converted
+// in batches with StringsToNumbers.  Bit i % 64 of GetErrors()[i / 64] is
+// set if and only if field i wasn't a valid number (including when the
+// record had no such field), in which case value i is whatever
+// StringsToNumbers produced.
+template <typename T>
+class DSVNumericColumn : public DSVColumn {
+
+public:
+    DSVNumericColumn() : ErrorCount(0), Staged(1, 0) {}
+
+    size_t GetCount() const { assert(this); return Values.size(); }
+
+    T GetValue(size_t index) const {
+        assert(this);
+        assert(index < Values.size());
+        return Values[index];
+    }
+
+    bool IsError(size_t index) const {
+        assert(this);
+        assert(index < Values.size());
+        return (Errors[index / 64] >> (index % 64)) & 1;
+    }
+
+    const std::vector<T> &GetValues() const { assert(this); return Values; }
+    const std::vector<uint64_t> &GetErrors() const {
+        assert(this);
+        return Errors;
+    }
+
+    size_t GetErrorCount() const { assert(this); return ErrorCount; }
+
+    void Clear() {
+        assert(this);
+        Values.clear();
+        Errors.clear();
+        ErrorCount = 0;
+        StagedBytes.clear();
+        Staged.assign(1, 0);
+    }
+
+private:
+    template <typename C, typename D> friend class DSVColumnLoader;
+
+    void Flush() {
+        assert(this);
+        auto count = Staged.size() - 1;
+        if (count == 0) {
+            return;
+        }
+        std::vector<uint64_t> errors((count + 63) / 64);
+        auto first = Values.size();
+        Values.resize(first + count);
+        ErrorCount += StringsToNumbers<T>(StagedBytes.data(), Staged.data(),
+          count, Values.data() + first, errors.data());
+
+        // Append the batch's error bits to the column's bitmap.
+        Errors.resize((Values.size() + 63) / 64);
+        for (size_t index = 0; index < count; ++index) {
+            if ((errors[index / 64] >> (index % 64)) & 1) {
+                auto position = first + index;
+                Errors[position / 64] |= UINT64_C(1) << (position % 64);
+            }
+        }
+        StagedBytes.clear();
+        Staged.assign(1, 0);
+    }
+
+    std::vector<T> Values;
+    std::vector<uint64_t> Errors;
+    size_t ErrorCount;
+
+    // the characters of fields that haven't been converted yet, in the
+    // same layout as DSVStringColumn's
+    std::vector<char> StagedBytes;
+    std::vector<size_t> Staged;
+
+};  // class DSVNumericColumn
+
+// Instances of this class parse DSV and load selected fields into columns.
+// Add columns with AddStringColumn and AddNumericColumn before parsing, then
+// parse with the usual DSVParser methods (Parse, FeedCharacters, etc.),
+// and call Flush after FinishParsing.  Fields that aren't selected are
+// never copied or passed to the loader (see DSVParser's IsFieldWanted).
+// Every record adds exactly one value to each column, so the columns
+// always have the same number of values; missing fields produce empty
+// strings or erroneous numbers.
+//
+// Delimiters is a DSVParser delimiter policy.  If it's void (the default),
+// the separator and escape characters passed to the constructor are used;
+// otherwise, they're fixed at compile time (e.g., by UnixDSVDelimiters)
+// and the constructor's are ignored.
+template <typename _CharT = char, typename Delimiters = void>
+class DSVColumnLoader : public DSVParser<DSVColumnLoader<_CharT, Delimiters>,
+  _CharT, Delimiters> {
+
+public:
+    typedef _CharT CharT;
+
+    // This many records' numeric fields are staged before they're
+    // converted.
+    static const size_t BatchSize = 4096;
+
+    DSVColumnLoader(CharT separator = ':', CharT escape = '\\')
+      : SeparatorChar(separator), EscapeChar(escape), RecordCount(0),
+        Pending(0) {}
+
+    DSVColumnLoader(const DSVColumnLoader &that) = delete;
+    DSVColumnLoader &operator=(const DSVColumnLoader &that) = delete;
+
+    ~DSVColumnLoader() {
+        assert(this);
+        this->Reset();
+    }
+
+    // Load the field with the specified index into a string column.
+    // The column is owned by the loader.
+    DSVStringColumn<CharT> &AddStringColumn(size_t field) {
+        assert(this);
+        auto column = new DSVStringColumn<CharT>;
+        Columns.emplace_back(column);
+        AddTarget(field, &column->Bytes, &column->Offsets);
+        return *column;
+    }
+
+    // Load the field with the specified index into a column of Ts, which
+    // must be an arithmetic type.  The column is owned by the loader.
+    template <typename T>
+    DSVNumericColumn<T> &AddNumericColumn(size_t field) {
+        assert(this);
+        static_assert(std::is_same<CharT, char>::value,
+          "numeric columns require char input");
+        auto column = new DSVNumericColumn<T>;
+        Columns.emplace_back(column);
+        AddTarget(field, &column->StagedBytes, &column->Staged);
+        return *column;
+    }
+
+    // Convert the numeric fields that are still staged.  Call this after
+    // FinishParsing and before reading numeric columns.
+    void Flush() {
+        assert(this);
+        for (auto &column : Columns) {
+            column->Flush();
+        }
+        Pending = 0;
+    }
+
+    size_t GetRecordCount() const { assert(this); return RecordCount; }
+
+    // Empty all of the columns and reset the parser.  The columns
+    // themselves remain.  Call this instead of Reset: Resetting the parser
+    // in the middle of a record leaves the columns inconsistent.
+    void Clear() {
+        assert(this);
+        this->Reset();
+        for (auto &column : Columns) {
+            column->Clear();
+        }
+        RecordCount = 0;
+        Pending = 0;
+    }
+
+    CharT GetSeparator() const { assert(this); return SeparatorChar; }
+    CharT GetEscape() const { assert(this); return EscapeChar; }
+
+private:
+    friend class DSVParser<DSVColumnLoader, CharT, Delimiters>;
+
+    // This is where a field's characters go.  Bytes is null if the field
+    // isn't loaded.
+    struct Target {
+        std::vector<CharT> *Bytes;
+        std::vector<size_t> *Offsets;
+    };
+
+    void AddTarget(size_t field, std::vector<CharT> *bytes,
+      std::vector<size_t> *offsets) {
+        assert(this);
+        assert(!this->IsInRecord());
+        assert(RecordCount == 0);
+        if (field >= Targets.size()) {
+            Target none = { nullptr, nullptr };
+            Targets.resize(field + 1, none);
+        }
+        assert(!Targets[field].Bytes);
+        Targets[field].Bytes = bytes;
+        Targets[field].Offsets = offsets;
+    }
+
+    bool IsFieldWanted(size_t index) {
+        assert(this);
+        return index < Targets.size() && Targets[index].Bytes;
+    }
+
+    void OnRecordStart() {}
+
+    void OnFieldChunk(const CharT *begin, const CharT *end) {
+        assert(this);
+        auto bytes = Targets[this->GetFieldIndex()].Bytes;
+        bytes->insert(bytes->end(), begin, end);
+    }
+
+    void OnFieldEnd() {
+        assert(this);
+        auto index = this->GetFieldIndex();
+        Targets[index].Offsets->push_back(Targets[index].Bytes->size());
+    }
+
+    void OnRecordEnd() {
+        assert(this);
+
+        // Give the columns of missing fields empty values.
+        for (auto index = this->GetFieldIndex() + 1; index < Targets.size();
+          ++index) {
+            if (Targets[index].Bytes) {
+                Targets[index].Offsets->push_back(
+                  Targets[index].Bytes->size());
+            }
+        }
+        ++RecordCount;
+        if (++Pending == BatchSize) {
+            Flush();
+        }
+    }
+
+    void OnReset() {}
+
+    CharT SeparatorChar;
+    CharT EscapeChar;
+    std::vector<std::unique_ptr<DSVColumn>> Columns;
+
+    // the destinations of fields, indexed by field number
+    std::vector<Target> Targets;
+
+    size_t RecordCount;
+
+    // the number of records whose numeric fields are staged
+    size_t Pending;
+
+};  // class DSVColumnLoader
+
+}   // namespace libpt
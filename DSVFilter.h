@@ -0,0 +1,509 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for finding the DSV records whose values for
+// a field equal or begin with a string without parsing every record.  It
+// searches the raw input for the string and only examines the records in
+// which it appears.
+//
+// The char search compares the string's first and last characters sixteen
+// positions at a time, and looks for escapes of ordinary characters in the
+// same pass, with SSE2 if the compiler targets it (as indicated by
+// __SSE2__) and uses memchr otherwise.  Other character types use
+// std::search.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <DSV.h>
+#include <DSVScan.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace libpt {
+
+// This selects how DSVRecordFilters compare fields with their patterns.
+enum class DSVFilterMode {
+    // Match fields that equal the pattern.
+    Equal,
+
+    // Match fields that begin with the pattern.
+    Prefix
+};
+
+// Instances of this class find the records whose field_index'th fields
+// match a pattern (see DSVFilterMode) and pass them to consumers as
+// ranges of the input, newlines included, so matching records can be
+// written out verbatim or fed to DSVParsers without being copied.
+//
+// A field's raw characters usually contain the pattern with its
+// separators, escapes, and newlines escaped, so the filter searches for
+// that and only walks (with the escape-aware rules of DSVParser) the
+// records in which it's found, skipping from one occurrence to the next.
+// Fields that escape other characters (e.g., "\a" for "a", which
+// DSVWriters never write) needn't contain it, so the filter also walks
+// every record containing such an escape.  An empty pattern can't be
+// searched for, so every record is walked.
+//
+// If Delimiters is void, the separator and escape passed to the
+// constructor are used; otherwise, Delimiters::Separator and
+// Delimiters::Escape are (see DSVDelimiters).
+template <typename _CharT = char, typename Delimiters = void>
+class DSVRecordFilter {
+
+public:
+    typedef _CharT CharT;
+
+    // field_index is the zero-based index of the field to match.
+    DSVRecordFilter(size_t field_index,
+      const std::basic_string<CharT> &pattern,
+      DSVFilterMode mode = DSVFilterMode::Equal, CharT separator = ':',
+      CharT escape = '\\')
+      : FieldIndex(field_index), Pattern(pattern), Mode(mode),
+        SeparatorChar(separator), EscapeChar(escape) {
+        assert(this);
+        const CharT escape_char = GetEscapeChar();
+        for (auto c : Pattern) {
+            if (c == GetSeparatorChar() || c == escape_char || c == '\n') {
+                Needle.push_back(escape_char);
+            }
+            Needle.push_back(c);
+        }
+    }
+
+    // Pass each matching record in [begin, end), which must begin at a
+    // record boundary, to consume, a function taking a record's first
+    // character and the character after it (or after its newline, if it
+    // has one).  Return the number of matching records.
+    template <typename Consumer>
+    uint64_t Filter(const CharT *begin, const CharT *end,
+      Consumer consume) const {
+        assert(this);
+        assert(begin <= end);
+        uint64_t count = 0;
+        const CharT *record_end;
+        if (Needle.empty()) {
+            for (auto record = begin; record != end; record = record_end) {
+                if (Matches(record, end, &record_end)) {
+                    consume(record, record_end);
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        // Walk the records containing candidates (see FindCandidate),
+        // skipping from one to the next.  literal is FindCandidate's
+        // cache.
+        auto floor = begin;
+        const CharT *literal = nullptr;
+        while (floor != end) {
+            auto candidate = FindCandidate(floor, end, &literal);
+            if (candidate == end) {
+                break;
+            }
+            auto record = FindRecordStart(floor, candidate);
+            if (Matches(record, end, &record_end)) {
+                consume(record, record_end);
+                ++count;
+            }
+            floor = record_end;
+        }
+        return count;
+    }
+
+    // Pass each matching record that reader, which must implement
+    // ReadBlock (see DSVParser::Parse), supplies to consume as above.  The
+    // records are only valid for the duration of the calls.  Records that
+    // lie within blocks aren't copied; those that straddle blocks are
+    // gathered in a buffer.  Return the number of matching records.
+    template <typename Reader, typename Consumer>
+    uint64_t Filter(Reader &reader, Consumer consume) {
+        assert(this);
+        assert(&reader);
+        uint64_t count = 0;
+        const CharT *block;
+        size_t size;
+
+        // true if the carried record's next character is escaped
+        auto escaping = false;
+        Carry.clear();
+        while ((size = reader.ReadBlock(&block)) != 0) {
+            auto end = block + size;
+            if (!Carry.empty()) {
+                auto record_end = FindRecordEnd(block, end, &escaping);
+                Carry.insert(Carry.end(), block, record_end);
+                if (record_end == end) {
+                    continue;
+                }
+                count += Filter(Carry.data(), Carry.data() + Carry.size(),
+                  consume);
+                Carry.clear();
+                block = record_end;
+            }
+            auto last = FindLastRecordEnd(block, end, &escaping);
+            count += Filter(block, last, consume);
+            Carry.assign(last, end);
+        }
+        if (!Carry.empty()) {
+            count += Filter(Carry.data(), Carry.data() + Carry.size(),
+              consume);
+            Carry.clear();
+        }
+        return count;
+    }
+
+    // Feed each matching record that reader supplies to parser, a
+    // DSVParser, and call parser's FinishParsing.  Return the number of
+    // matching records.
+    template <typename Reader, typename Parser>
+    uint64_t Parse(Reader &reader, Parser &parser) {
+        assert(this);
+        assert(&parser);
+        auto count = Filter(reader,
+          [&parser](const CharT *record, const CharT *record_end) {
+              parser.FeedCharacters(record, record_end);
+          });
+        parser.FinishParsing();
+        return count;
+    }
+
+    size_t GetFieldIndex() const { assert(this); return FieldIndex; }
+
+    const std::basic_string<CharT> &GetPattern() const {
+        assert(this);
+        return Pattern;
+    }
+
+    DSVFilterMode GetMode() const { assert(this); return Mode; }
+
+private:
+    typedef detail::DSVDelimiterTraits<CharT, Delimiters> DelimiterTraits;
+
+    CharT GetSeparatorChar() const {
+        return DelimiterTraits::GetSeparator(SeparatorChar);
+    }
+
+    CharT GetEscapeChar() const {
+        return DelimiterTraits::GetEscape(EscapeChar);
+    }
+
+    // Return a pointer to the first occurrence of [needle, needle + size)
+    // in [begin, end) or end if there is none.  size must be positive.
+    template <typename T>
+    static const T *Search(const T *begin, const T *end, const T *needle,
+      size_t size) {
+        return std::search(begin, end, needle, needle + size);
+    }
+
+    static const char *Search(const char *begin, const char *end,
+      const char *needle, size_t size) {
+        if (static_cast<size_t>(end - begin) < size) {
+            return end;
+        }
+
+        // the last position where the needle could begin
+        auto last = end - size;
+        auto c = begin;
+#if defined(__SSE2__)
+        auto firsts = _mm_set1_epi8(needle[0]);
+        auto lasts = _mm_set1_epi8(needle[size - 1]);
+        for (; last - c >= 16; c += 16) {
+            auto heads = _mm_loadu_si128(reinterpret_cast<const __m128i *>(c));
+            auto tails = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(c + size - 1));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+              _mm_and_si128(_mm_cmpeq_epi8(heads, firsts),
+                _mm_cmpeq_epi8(tails, lasts))));
+            while (mask) {
+                auto candidate = c + __builtin_ctz(mask);
+                if (memcmp(candidate, needle, size) == 0) {
+                    return candidate;
+                }
+                mask &= mask - 1;
+            }
+        }
+#endif
+        while (c <= last) {
+            auto first = static_cast<const char *>(memchr(c, needle[0],
+              static_cast<size_t>(last - c) + 1));
+            if (!first) {
+                break;
+            } else if (memcmp(first, needle, size) == 0) {
+                return first;
+            }
+            c = first + 1;
+        }
+        return end;
+    }
+
+    // Return a pointer to the first escape in [c, end) that's followed by
+    // an ordinary character (not a separator, escape, or newline), or end
+    // if there's none.  The escape may itself be escaped, but every escape
+    // of an ordinary character is found.
+    template <typename T>
+    static const T *FindLiteralEscape(const T *c, const T *end,
+      T separator, T escape) {
+        for (; end - c >= 2; ++c) {
+            if (c[0] == escape && c[1] != separator && c[1] != escape &&
+              c[1] != '\n') {
+                return c;
+            }
+        }
+        return end;
+    }
+
+    // Return a pointer to the first candidate in [begin, end) or end if
+    // there is none.  Candidates are occurrences of the needle and the
+    // escapes found by FindLiteralEscape.  *literal caches the first such
+    // escape across calls with increasing begins; it must be null
+    // initially.
+    template <typename T>
+    static const T *FindCandidate(const T *begin, const T *end,
+      const T *needle, size_t size, T separator, T escape,
+      const T **literal) {
+        if (!*literal || *literal < begin) {
+            *literal = FindLiteralEscape(begin, end, separator, escape);
+        }
+
+        // Only occurrences of the needle before the escape matter, so the
+        // needle is never searched for beyond it.
+        auto limit = static_cast<size_t>(end - *literal) > size - 1
+          ? *literal + (size - 1) : end;
+        auto found = Search(begin, limit, needle, size);
+        return found != limit ? found : *literal;
+    }
+
+    // This compares each position with the needle's first and last
+    // characters and checks for escapes of ordinary characters sixteen
+    // positions at a time, so the input is only scanned once.
+    static const char *FindCandidate(const char *begin, const char *end,
+      const char *needle, size_t size, char separator, char escape,
+      const char **literal) {
+#if defined(__SSE2__)
+        auto c = begin;
+        if (static_cast<size_t>(end - begin) >= size + 16) {
+            // the last position where the needle could begin
+            auto last = end - size;
+            auto firsts = _mm_set1_epi8(needle[0]);
+            auto lasts = _mm_set1_epi8(needle[size - 1]);
+            auto separators = _mm_set1_epi8(separator);
+            auto escapes = _mm_set1_epi8(escape);
+            auto newlines = _mm_set1_epi8('\n');
+            for (; last - c >= 16; c += 16) {
+                auto heads = _mm_loadu_si128(
+                  reinterpret_cast<const __m128i *>(c));
+                auto nexts = _mm_loadu_si128(
+                  reinterpret_cast<const __m128i *>(c + 1));
+                auto tails = _mm_loadu_si128(
+                  reinterpret_cast<const __m128i *>(c + size - 1));
+                auto specials = _mm_or_si128(
+                  _mm_or_si128(_mm_cmpeq_epi8(nexts, separators),
+                    _mm_cmpeq_epi8(nexts, escapes)),
+                  _mm_cmpeq_epi8(nexts, newlines));
+                auto literals = static_cast<uint32_t>(_mm_movemask_epi8(
+                  _mm_andnot_si128(specials,
+                    _mm_cmpeq_epi8(heads, escapes))));
+                auto mask = literals | static_cast<uint32_t>(
+                  _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(heads, firsts),
+                    _mm_cmpeq_epi8(tails, lasts))));
+                for (; mask; mask &= mask - 1) {
+                    auto bit = mask & (0 - mask);
+                    auto candidate = c + __builtin_ctz(mask);
+                    if ((literals & bit) ||
+                      memcmp(candidate, needle, size) == 0) {
+                        return candidate;
+                    }
+                }
+            }
+        }
+        *literal = nullptr;
+        return FindCandidate<char>(c, end, needle, size, separator, escape,
+          literal);
+#else
+        return FindCandidate<char>(begin, end, needle, size, separator,
+          escape, literal);
+#endif
+    }
+
+    const CharT *FindCandidate(const CharT *begin, const CharT *end,
+      const CharT **literal) const {
+        return FindCandidate(begin, end, Needle.data(), Needle.size(),
+          GetSeparatorChar(), GetEscapeChar(), literal);
+    }
+
+    // Return a pointer to the start of the record containing c, not
+    // looking before begin, which must be a record boundary.  A newline
+    // ends a record if it's preceded by an even number of escapes.
+    const CharT *FindRecordStart(const CharT *begin, const CharT *c) const {
+        const CharT escape = GetEscapeChar();
+        while (c != begin) {
+            --c;
+            if (*c == '\n') {
+                auto run = c;
+                while (run != begin && run[-1] == escape) {
+                    --run;
+                }
+                if ((c - run) % 2 == 0) {
+                    return c + 1;
+                }
+
+                // The escapes can't precede another newline.
+                c = run;
+            }
+        }
+        return begin;
+    }
+
+    // Return a pointer to the character after the first unescaped newline
+    // in [c, end) or end if there's none.  If *escaping is true, c is
+    // escaped.  On return, *escaping is true if end is escaped.
+    const CharT *FindRecordEnd(const CharT *c, const CharT *end,
+      bool *escaping) const {
+        const CharT escape = GetEscapeChar();
+        if (*escaping) {
+            if (c == end) {
+                return end;
+            }
+            *escaping = false;
+            ++c;
+        }
+        while (true) {
+            auto special = DelimiterTraits::FindEscapeOrNewline(c, end,
+              escape);
+            if (special == end) {
+                return end;
+            } else if (*special != escape) {
+                return special + 1;
+            } else if (special + 1 == end) {
+                *escaping = true;
+                return end;
+            }
+            c = special + 2;
+        }
+    }
+
+    // This is FindRecordEnd for a c that isn't escaped.
+    const CharT *FindRecordEnd(const CharT *c, const CharT *end) const {
+        auto escaping = false;
+        return FindRecordEnd(c, end, &escaping);
+    }
+
+    // Return a pointer to the character after the last unescaped newline
+    // in [begin, end), which must begin at a record boundary, or begin if
+    // there's none.  Set *escaping to true if end is escaped.
+    const CharT *FindLastRecordEnd(const CharT *begin, const CharT *end,
+      bool *escaping) const {
+        const CharT escape = GetEscapeChar();
+        auto last = FindRecordStart(begin, end);
+        auto run = end;
+        while (run != last && run[-1] == escape) {
+            --run;
+        }
+        *escaping = (end - run) % 2 != 0;
+        return last;
+    }
+
+    // Compare [piece, piece_end), which is part of the field, with the
+    // unmatched part of the pattern, [*pattern, pattern_end).
+    bool MatchPiece(const CharT *piece, const CharT *piece_end,
+      const CharT **pattern, const CharT *pattern_end) const {
+        auto size = static_cast<size_t>(piece_end - piece);
+        auto left = static_cast<size_t>(pattern_end - *pattern);
+        if (size > left) {
+            if (Mode == DSVFilterMode::Equal) {
+                return false;
+            }
+            size = left;
+        }
+        if (!std::equal(piece, piece + size, *pattern)) {
+            return false;
+        }
+        *pattern += size;
+        return true;
+    }
+
+    // Return true if the record that starts at record matches and store a
+    // pointer to the character after it (or after its newline) in
+    // *record_end.  Empty lines aren't records and never match.
+    bool Matches(const CharT *record, const CharT *end,
+      const CharT **record_end) const {
+        const CharT separator = GetSeparatorChar();
+        const CharT escape = GetEscapeChar();
+        if (*record == '\n') {
+            *record_end = record + 1;
+            return false;
+        }
+        auto pattern = Pattern.data();
+        auto pattern_end = pattern + Pattern.size();
+        size_t field = 0;
+        auto c = record;
+        while (c != end) {
+            auto special = DelimiterTraits::FindSpecial(c, end, separator,
+              escape);
+            if (field == FieldIndex) {
+                if (!MatchPiece(c, special, &pattern, pattern_end)) {
+                    *record_end = FindRecordEnd(special, end);
+                    return false;
+                }
+            }
+            if (special == end) {
+                break;
+            } else if (*special == escape) {
+                if (special + 1 == end) {
+                    break;
+                }
+                if (field == FieldIndex && !MatchPiece(special + 1,
+                  special + 2, &pattern, pattern_end)) {
+                    *record_end = FindRecordEnd(special + 2, end);
+                    return false;
+                }
+                c = special + 2;
+            } else if (*special == separator) {
+                if (field == FieldIndex) {
+                    *record_end = FindRecordEnd(special + 1, end);
+                    return pattern == pattern_end;
+                }
+                ++field;
+                c = special + 1;
+            } else {
+                *record_end = special + 1;
+                return field == FieldIndex && pattern == pattern_end;
+            }
+        }
+        *record_end = end;
+        return field == FieldIndex && pattern == pattern_end;
+    }
+
+    size_t FieldIndex;
+    std::basic_string<CharT> Pattern;
+    DSVFilterMode Mode;
+    CharT SeparatorChar;
+    CharT EscapeChar;
+
+    // the pattern as it appears in raw fields
+    std::basic_string<CharT> Needle;
+
+    // the incomplete record at the end of the last block
+    std::vector<CharT> Carry;
+
+};  // class DSVRecordFilter
+
+}   // namespace libpt
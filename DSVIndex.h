@@ -0,0 +1,564 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines classes and functions for indexing the records of
+// large DSV files and parsing individual records (by number or by the
+// value of a key field) without parsing the records before them.  Saving
+// record indexes requires POSIX.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+#include <DSV.h>
+#include <DSVScan.h>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// Instances of this class find the first characters of DSV records in
+// input fed to them in arbitrary pieces.  They track the same escaping and
+// in-record state that DSVParser does, so they agree with it about where
+// records start (empty lines aren't records), but they only look for
+// escapes and newlines.
+template <typename _CharT = char>
+class DSVRecordScanner {
+
+public:
+    typedef _CharT CharT;
+
+    DSVRecordScanner(CharT escape = '\\')
+      : EscapeChar(escape), Escaping(false), InRecord(false), Records(0) {
+        assert(this);
+    }
+
+    // Return a pointer to the first character of the next record in
+    // [begin, end) or end if no record starts there.  To continue, call
+    // this again with the returned pointer as begin.
+    const CharT *FindRecordStart(const CharT *begin, const CharT *end) {
+        assert(this);
+        assert(begin <= end);
+        while (begin != end) {
+            if (Escaping) {
+                Escaping = false;
+                ++begin;
+            } else if (!InRecord) {
+                begin = SkipNewlines(begin, end);
+                if (begin != end) {
+                    InRecord = true;
+                    ++Records;
+                    return begin;
+                }
+            } else {
+                auto special = FindDSVSpecial(begin, end, EscapeChar,
+                  EscapeChar);
+                if (special == end) {
+                    break;
+                }
+                if (*special == EscapeChar) {
+                    Escaping = true;
+                } else {
+                    InRecord = false;
+                }
+                begin = special + 1;
+            }
+        }
+        return end;
+    }
+
+    // Return the number of records whose starts have been found.
+    uint64_t GetRecordCount() const { assert(this); return Records; }
+
+    bool IsInRecord() const { assert(this); return InRecord; }
+    bool IsEscaping() const { assert(this); return Escaping; }
+    CharT GetEscape() const { assert(this); return EscapeChar; }
+
+    void Reset() {
+        assert(this);
+        Escaping = InRecord = false;
+        Records = 0;
+    }
+
+private:
+    static const CharT *SkipNewlines(const CharT *begin, const CharT *end) {
+        while (begin != end && *begin == '\n') {
+            ++begin;
+        }
+        return begin;
+    }
+
+    CharT EscapeChar;
+    bool Escaping;
+    bool InRecord;
+    uint64_t Records;
+
+};  // class DSVRecordScanner
+
+// Instances of this class hold the byte offsets of every interval-th
+// record in a DSV file (records 0, interval, 2 * interval, and so on),
+// which ParseDSVRecords uses to parse records without parsing the records
+// before them.  Indexes can be saved to and loaded from sidecar files.
+class DSVRecordIndex {
+
+public:
+    static const size_t DefaultInterval = 1024;
+
+    DSVRecordIndex(size_t interval = DefaultInterval, char escape = '\\')
+      : Interval(interval), EscapeChar(escape), RecordCount(0),
+        InputSize(0) {
+        assert(this);
+        assert(interval > 0);
+    }
+
+    // Index the records read from reader, which must implement ReadBlock
+    // (see DSVParser::Parse) and be positioned at the start of the file.
+    // This replaces the index's contents.
+    template <typename Reader>
+    void Build(Reader &reader) {
+        assert(this);
+        assert(&reader);
+        Offsets.clear();
+        RecordCount = InputSize = 0;
+        DSVRecordScanner<char> scanner(EscapeChar);
+        const char *block;
+        size_t size;
+        while ((size = reader.ReadBlock(&block)) != 0) {
+            auto end = block + size;
+            auto start = scanner.FindRecordStart(block, end);
+            for (; start != end; start = scanner.FindRecordStart(start, end)) {
+                if ((scanner.GetRecordCount() - 1) % Interval == 0) {
+                    Offsets.push_back(InputSize +
+                      static_cast<uint64_t>(start - block));
+                }
+            }
+            InputSize += size;
+        }
+        RecordCount = scanner.GetRecordCount();
+    }
+
+    size_t GetInterval() const { assert(this); return Interval; }
+    char GetEscape() const { assert(this); return EscapeChar; }
+    uint64_t GetRecordCount() const { assert(this); return RecordCount; }
+
+    // Return the size of the indexed file.  Compare it with the file's
+    // current size to detect stale indexes.
+    uint64_t GetInputSize() const { assert(this); return InputSize; }
+
+    const std::vector<uint64_t> &GetOffsets() const {
+        assert(this);
+        return Offsets;
+    }
+
+    // Return the offset of the last indexed record at or before record,
+    // which must be less than GetRecordCount(), and store the number of
+    // records between the two in *skip.
+    uint64_t FindCheckpoint(uint64_t record, uint64_t *skip) const {
+        assert(this);
+        assert(record < RecordCount);
+        assert(skip);
+        *skip = record % Interval;
+        return Offsets[record / Interval];
+    }
+
+    // Write the index to the file at the specified path in the host's byte
+    // order.  It's written to a temporary file (path with ".tmp" appended),
+    // which is synced to disk and then replaces the file, so an
+    // interrupted save never leaves a truncated index behind.  This throws
+    // FileOpenException if the temporary file can't be created and
+    // IOException if it can't be written or renamed.
+    void Save(const char *path) const {
+        assert(this);
+        assert(path);
+        auto temporary = std::string(path) + ".tmp";
+        auto file = fopen(temporary.c_str(), "wb");
+        if (!file) {
+            throw FileOpenException(path, errno);
+        }
+        uint64_t header[] = { Magic, Interval,
+          static_cast<unsigned char>(EscapeChar), RecordCount, InputSize,
+          Offsets.size() };
+        auto written = fwrite(header, sizeof(header), 1, file) == 1 &&
+          fwrite(Offsets.data(), sizeof(uint64_t), Offsets.size(), file) ==
+          Offsets.size() && fflush(file) == 0 && fsync(fileno(file)) == 0;
+        auto error = errno;
+        if (fclose(file) != 0 && written) {
+            written = false;
+            error = errno;
+        }
+        if (written && rename(temporary.c_str(), path) != 0) {
+            written = false;
+            error = errno;
+        }
+        if (!written) {
+            remove(temporary.c_str());
+            throw IOException(path, error);
+        }
+    }
+
+    // Replace the index with the one in the file at the specified path.
+    // This throws FileOpenException if the file can't be opened and
+    // IOException if it can't be read or isn't an index (in which case the
+    // errno value is EINVAL).
+    void Load(const char *path) {
+        assert(this);
+        assert(path);
+        auto file = fopen(path, "rb");
+        if (!file) {
+            throw FileOpenException(path, errno);
+        }
+        uint64_t header[6];
+        std::vector<uint64_t> offsets;
+        auto error = EINVAL;
+        if (fread(header, sizeof(header), 1, file) == 1 &&
+          header[0] == Magic && header[1] != 0 &&
+          header[5] == (header[3] + header[1] - 1) / header[1]) {
+            offsets.resize(header[5]);
+            if (fread(offsets.data(), sizeof(uint64_t), offsets.size(),
+              file) == offsets.size()) {
+                error = 0;
+            }
+        }
+        if (ferror(file)) {
+            error = errno;
+        }
+        fclose(file);
+        if (error != 0) {
+            throw IOException(path, error);
+        }
+        Interval = header[1];
+        EscapeChar = static_cast<char>(header[2]);
+        RecordCount = header[3];
+        InputSize = header[4];
+        Offsets.swap(offsets);
+    }
+
+private:
+    // "libptDSV" in little-endian byte order
+    static const uint64_t Magic = UINT64_C(0x565344747062696C);
+
+    size_t Interval;
+    char EscapeChar;
+    uint64_t RecordCount;
+    uint64_t InputSize;
+    std::vector<uint64_t> Offsets;
+
+};  // class DSVRecordIndex
+
+// Parse count records of an indexed file starting with record first (both
+// zero-based) with parser, a DSVParser.  reader must read the indexed file
+// and implement ReadBlock and Seek (like DescriptorReader, FileReader, and
+// MappedFileReader).  The reader is positioned at the nearest indexed
+// record and the records before first are skipped without being parsed.
+// The parser is reset first and FinishParsing is called afterward.
+// Return the number of records passed to the parser, which is less than
+// count if the file has fewer records.
+template <typename Reader, typename Parser>
+uint64_t ParseDSVRecords(const DSVRecordIndex &index, Reader &reader,
+  Parser &parser, uint64_t first, uint64_t count = 1) {
+    assert(&index);
+    assert(&reader);
+    assert(&parser);
+    parser.Reset();
+    if (first >= index.GetRecordCount() || count == 0) {
+        return 0;
+    }
+    count = std::min(count, index.GetRecordCount() - first);
+    uint64_t skip;
+    reader.Seek(index.FindCheckpoint(first, &skip));
+    DSVRecordScanner<char> scanner(index.GetEscape());
+    const char *block;
+    size_t size;
+    auto feeding = false;
+    while ((size = reader.ReadBlock(&block)) != 0) {
+        auto end = block + size;
+        auto feed_begin = block;
+        auto start = scanner.FindRecordStart(block, end);
+        for (; start != end; start = scanner.FindRecordStart(start, end)) {
+            auto record = scanner.GetRecordCount() - 1;
+            if (record == skip) {
+                feeding = true;
+                feed_begin = start;
+            } else if (record == skip + count) {
+                parser.FeedCharacters(feed_begin, start);
+                parser.FinishParsing();
+                return count;
+            }
+        }
+        if (feeding) {
+            parser.FeedCharacters(feed_begin, end);
+        }
+    }
+    parser.FinishParsing();
+    return count;
+}
+
+// Instances of this class index the records of contiguous DSV inputs (such
+// as MappedFileReaders' mappings) by the value of one of their fields, the
+// key, so that records can be found by key without parsing the input.
+// The index is an open-addressing hash table whose slots hold a record's
+// offset and a few bits of its key's hash in 64 bits, so it costs between
+// ten and twenty bytes per record.  Keys are compared with the input's
+// fields, so the input must outlive the index (or the next Build), and it
+// mustn't be larger than 2^48 characters.
+//
+// Keys are compared after unescaping.  Records that lack the key field
+// aren't indexed.  If several records have the same key, Find returns the
+// first one.
+//
+// Delimiters is a DSVParser delimiter policy.  If it's void (the default),
+// the separator and escape characters passed to the constructor are used;
+// otherwise, they're fixed at compile time (e.g., by UnixDSVDelimiters)
+// and the constructor's are ignored.
+template <typename _CharT = char, typename Delimiters = void>
+class DSVKeyIndex {
+
+public:
+    typedef _CharT CharT;
+
+    // field_index is the zero-based index of the key field.
+    DSVKeyIndex(size_t field_index = 0, CharT separator = ':',
+      CharT escape = '\\')
+      : FieldIndex(field_index), SeparatorChar(separator),
+        EscapeChar(escape), Begin(nullptr), End(nullptr), Mask(0),
+        RecordCount(0) {
+        assert(this);
+    }
+
+    // Index the records in [begin, end), replacing the index's contents.
+    void Build(const CharT *begin, const CharT *end) {
+        assert(this);
+        assert(begin <= end);
+        assert(static_cast<uint64_t>(end - begin) < OffsetMask);
+        Begin = begin;
+        End = end;
+        RecordCount = 0;
+
+        // Every record but the last ends with a newline, so there are at
+        // most newlines + 1 records.  Keep the table at most 80% full.
+        size_t records = 1;
+        for (auto c = begin; c != end && (c = FindDSVNewline(c, end)) != end;
+          ++c) {
+            ++records;
+        }
+        size_t slots = 16;
+        while (slots < records + records / 4) {
+            slots *= 2;
+        }
+        Table.assign(slots, 0);
+        Mask = slots - 1;
+
+        auto record = begin;
+        while (record != end) {
+            if (*record == '\n') {
+                ++record;
+                continue;
+            }
+            uint64_t hash = HashBasis;
+            auto has_key = false;
+            auto next = WalkRecord(record, false, &has_key,
+              [&hash](const CharT *piece, const CharT *piece_end) {
+                  hash = Hash(hash, piece, piece_end);
+              });
+            if (has_key) {
+                Insert(hash, static_cast<uint64_t>(record - begin));
+                ++RecordCount;
+            }
+            record = next;
+        }
+    }
+
+    // Return a pointer to the first character of the first record whose
+    // key is [key, key + size) or null if there is none.
+    const CharT *Find(const CharT *key, size_t size) const {
+        assert(this);
+        assert(key || size == 0);
+        if (Table.empty()) {
+            return nullptr;
+        }
+        auto hash = Hash(HashBasis, key, key + size);
+        auto tag = hash & TagMask;
+        for (auto index = static_cast<size_t>(hash) & Mask; Table[index];
+          index = (index + 1) & Mask) {
+            auto slot = Table[index];
+            if ((slot & TagMask) == tag) {
+                auto record = Begin + ((slot & OffsetMask) - 1);
+                if (KeyEquals(record, key, size)) {
+                    return record;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    const CharT *Find(const std::basic_string<CharT> &key) const {
+        assert(this);
+        return Find(key.data(), key.size());
+    }
+
+    // Parse the first record whose key is [key, key + size) with parser,
+    // a DSVParser, which is reset first and finished afterward.  Return
+    // false if there's no such record.
+    template <typename Parser>
+    bool ParseRecord(const CharT *key, size_t size, Parser &parser) const {
+        assert(this);
+        assert(&parser);
+        auto record = Find(key, size);
+        if (!record) {
+            return false;
+        }
+        auto has_key = false;
+        auto end = WalkRecord(record, false, &has_key,
+          [](const CharT *, const CharT *) {});
+        parser.Reset();
+        parser.FeedCharacters(record, end);
+        parser.FinishParsing();
+        return true;
+    }
+
+    template <typename Parser>
+    bool ParseRecord(const std::basic_string<CharT> &key,
+      Parser &parser) const {
+        assert(this);
+        return ParseRecord(key.data(), key.size(), parser);
+    }
+
+    size_t GetFieldIndex() const { assert(this); return FieldIndex; }
+
+    // Return the number of indexed records.
+    size_t GetRecordCount() const { assert(this); return RecordCount; }
+
+    // Return the size of the hash table in bytes.
+    size_t GetTableSize() const {
+        assert(this);
+        return Table.size() * sizeof(uint64_t);
+    }
+
+private:
+    // A slot holds the record's offset plus one in its low 48 bits (so
+    // empty slots are zero) and the top 16 bits of the key's hash.
+    static const uint64_t OffsetMask = (UINT64_C(1) << 48) - 1;
+    static const uint64_t TagMask = ~OffsetMask;
+
+    // These are the FNV-1a parameters.
+    static const uint64_t HashBasis = UINT64_C(14695981039346656037);
+    static const uint64_t HashPrime = UINT64_C(1099511628211);
+
+    static uint64_t Hash(uint64_t hash, const CharT *begin,
+      const CharT *end) {
+        typedef typename std::make_unsigned<CharT>::type Unsigned;
+        for (; begin != end; ++begin) {
+            hash = (hash ^ static_cast<Unsigned>(*begin)) * HashPrime;
+        }
+        return hash;
+    }
+
+    typedef detail::DSVDelimiterTraits<CharT, Delimiters> DelimiterTraits;
+
+    CharT GetSeparatorChar() const {
+        return DelimiterTraits::GetSeparator(SeparatorChar);
+    }
+
+    CharT GetEscapeChar() const {
+        return DelimiterTraits::GetEscape(EscapeChar);
+    }
+
+    void Insert(uint64_t hash, uint64_t offset) {
+        auto index = static_cast<size_t>(hash) & Mask;
+        while (Table[index]) {
+            index = (index + 1) & Mask;
+        }
+        Table[index] = (hash & TagMask) | (offset + 1);
+    }
+
+    // Pass the unescaped pieces of the key field of the record that starts
+    // at record to consume and set *has_key if the record has the field.
+    // Return a pointer to the character after the record's newline (or
+    // End), or, if stop_after_key is true, any pointer once the key
+    // field ends.
+    template <typename Consumer>
+    const CharT *WalkRecord(const CharT *record, bool stop_after_key,
+      bool *has_key, Consumer consume) const {
+        const CharT separator = GetSeparatorChar();
+        const CharT escape = GetEscapeChar();
+        size_t field = 0;
+        *has_key = FieldIndex == 0;
+        auto c = record;
+        while (c != End) {
+            auto special = DelimiterTraits::FindSpecial(c, End, separator,
+              escape);
+            auto in_key = field == FieldIndex;
+            if (in_key && special != c) {
+                consume(c, special);
+            }
+            if (special == End) {
+                break;
+            } else if (*special == escape) {
+                if (special + 1 == End) {
+                    break;
+                }
+                if (in_key) {
+                    consume(special + 1, special + 2);
+                }
+                c = special + 2;
+            } else if (*special == separator) {
+                if (in_key && stop_after_key) {
+                    return special;
+                }
+                if (++field == FieldIndex) {
+                    *has_key = true;
+                }
+                c = special + 1;
+            } else {
+                return special + 1;
+            }
+        }
+        return End;
+    }
+
+    bool KeyEquals(const CharT *record, const CharT *key, size_t size) const {
+        auto equal = true;
+        auto has_key = false;
+        WalkRecord(record, true, &has_key,
+          [&](const CharT *piece, const CharT *piece_end) {
+              auto piece_size = static_cast<size_t>(piece_end - piece);
+              if (!equal || piece_size > size ||
+                !std::equal(piece, piece_end, key)) {
+                  equal = false;
+                  return;
+              }
+              key += piece_size;
+              size -= piece_size;
+          });
+        return equal && has_key && size == 0;
+    }
+
+    size_t FieldIndex;
+    CharT SeparatorChar;
+    CharT EscapeChar;
+
+    // the indexed input
+    const CharT *Begin;
+    const CharT *End;
+
+    std::vector<uint64_t> Table;
+    size_t Mask;
+    size_t RecordCount;
+
+};  // class DSVKeyIndex
+
+}   // namespace libpt
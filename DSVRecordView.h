@@ -0,0 +1,256 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a pull-style interface for reading DSV records from
+// contiguous ranges of characters (e.g., strings or MappedFileReaders'
+// mappings) without copying their fields.  It requires C++17.
+
+#pragma once
+
+#include <cassert>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <DSV.h>
+
+namespace libpt {
+
+// Instances of this class describe DSV records.  Their fields are
+// std::basic_string_views that point straight into the input if the fields
+// contain no escape characters and into their DSVRecordReaders' scratch
+// buffers otherwise.  Either way, they're only valid until the next call
+// to the DSVRecordReader's ReadRecord method, and DSVRecordViews are only
+// meaningful after they're passed to ReadRecord.
+template <typename _CharT = char>
+class DSVRecordView {
+
+public:
+    typedef _CharT CharT;
+    typedef std::basic_string_view<CharT> Field;
+
+    size_t GetFieldCount() const { assert(this); return Fields.size(); }
+
+    const Field &GetField(size_t index) const {
+        assert(this);
+        assert(index < Fields.size());
+        return Fields[index];
+    }
+
+    const Field &operator[](size_t index) const { return GetField(index); }
+
+    const Field *begin() const { assert(this); return Fields.data(); }
+    const Field *end() const {
+        assert(this);
+        return Fields.data() + Fields.size();
+    }
+
+    // Return the raw text of the record (escape characters included) as
+    // it appears in the input, without the terminating newline.
+    const Field &GetText() const { assert(this); return Text; }
+
+private:
+    template <typename C, typename D> friend class DSVRecordReader;
+
+    std::vector<Field> Fields;
+    Field Text;
+
+};  // class DSVRecordView
+
+// Instances of this class read DSV records from contiguous ranges of
+// characters.  They don't own the ranges: Others must keep them alive and
+// unchanged while DSVRecordReaders use them.  Delimiters is a DSVParser
+// delimiter policy.  If it's void (the default), the separator and escape
+// characters passed to the constructor are used; otherwise, they're fixed
+// at compile time (e.g., by UnixDSVDelimiters) and the constructor's are
+// ignored.  Empty lines aren't records.
+//
+// Fields without escape characters are never copied.  Fields with escape
+// characters are unescaped into a scratch buffer that is reused for each
+// record, so reading records doesn't allocate once the buffers are large
+// enough.
+template <typename _CharT = char, typename Delimiters = void>
+class DSVRecordReader {
+
+public:
+    typedef _CharT CharT;
+
+    DSVRecordReader() = delete;
+    DSVRecordReader(const CharT *begin, const CharT *end,
+      CharT separator = ':', CharT escape = '\\')
+      : Begin(begin), Current(begin), End(end), Parser(separator, escape) {
+        assert(this);
+        assert(begin <= end);
+    }
+
+    DSVRecordReader(std::basic_string_view<CharT> input,
+      CharT separator = ':', CharT escape = '\\')
+      : DSVRecordReader(input.data(), input.data() + input.size(),
+          separator, escape) {}
+
+    DSVRecordReader(const DSVRecordReader &that) = delete;
+    DSVRecordReader &operator=(const DSVRecordReader &that) = delete;
+
+    // Read the next record into *record.  Return false if there are no
+    // more records.
+    bool ReadRecord(DSVRecordView<CharT> *record) {
+        assert(this);
+        assert(record);
+        Parser.Begin(record);
+        while (Current != End && *Current == '\n') {
+            ++Current;
+        }
+        if (Current == End) {
+            return false;
+        }
+        auto record_begin = Current;
+        while (true) {
+            auto newline = FindDSVNewline(Current, End);
+            if (newline == End) {
+                Parser.FeedCharacters(Current, End);
+                Current = End;
+                Parser.FinishParsing();
+                Parser.Finish(record_begin, End);
+                return true;
+            }
+            Parser.FeedCharacters(Current, newline);
+            auto escaped = Parser.IsEscaping();
+            Parser.FeedCharacters(newline, newline + 1);
+            Current = newline + 1;
+            if (!escaped) {
+                Parser.Finish(record_begin, newline);
+                return true;
+            }
+        }
+    }
+
+    // Return the position of the first character that ReadRecord hasn't
+    // consumed.
+    const CharT *GetPosition() const { assert(this); return Current; }
+
+    // Make the reader start over at the beginning of its input.
+    void Rewind() {
+        assert(this);
+        Parser.Reset();
+        Current = Begin;
+    }
+
+private:
+    // This parser collects the fields of a single record.  Each field is
+    // kept as a view of the input until a second chunk arrives (which only
+    // happens around escape characters), at which point it's copied into
+    // the scratch buffer.
+    class Collector : public DSVParser<Collector, CharT, Delimiters> {
+
+    public:
+        Collector(CharT separator, CharT escape)
+          : SeparatorChar(separator), EscapeChar(escape), Record(nullptr) {}
+
+        ~Collector() {
+            assert(this);
+            this->Reset();
+        }
+
+        void Begin(DSVRecordView<CharT> *record) {
+            assert(this);
+            assert(record);
+            Record = record;
+            Record->Fields.clear();
+            Scratch.clear();
+            Spans.clear();
+            ResetField();
+        }
+
+        // Turn the collected spans into views.  This can only be done once
+        // the record is complete because the scratch buffer may move.
+        void Finish(const CharT *text_begin, const CharT *text_end) {
+            assert(this);
+            assert(Record);
+            Record->Text = std::basic_string_view<CharT>(text_begin,
+              static_cast<size_t>(text_end - text_begin));
+            for (const auto &span : Spans) {
+                auto data = span.Data ? span.Data
+                  : Scratch.data() + span.Offset;
+                Record->Fields.emplace_back(data, span.Size);
+            }
+        }
+
+        void OnRecordStart() {}
+
+        void OnFieldChunk(const CharT *begin, const CharT *end) {
+            assert(this);
+            auto size = static_cast<size_t>(end - begin);
+            if (!InScratch) {
+                if (!Field.Data) {
+                    Field.Data = begin;
+                    Field.Size = size;
+                    return;
+                }
+                Field.Offset = Scratch.size();
+                Scratch.append(Field.Data, Field.Size);
+                Field.Data = nullptr;
+                InScratch = true;
+            }
+            Scratch.append(begin, size);
+            Field.Size += size;
+        }
+
+        void OnFieldEnd() {
+            assert(this);
+            Spans.push_back(Field);
+            ResetField();
+        }
+
+        void OnRecordEnd() {}
+
+        void OnReset() {
+            assert(this);
+            Spans.clear();
+            ResetField();
+        }
+
+        CharT GetSeparator() const { assert(this); return SeparatorChar; }
+        CharT GetEscape() const { assert(this); return EscapeChar; }
+
+    private:
+        // This is a field's characters: Data points to them if they're in
+        // the input; otherwise, Data is null and they're in the scratch
+        // buffer at Offset.
+        struct Span {
+            const CharT *Data;
+            size_t Offset;
+            size_t Size;
+        };
+
+        void ResetField() {
+            assert(this);
+            Field.Data = nullptr;
+            Field.Offset = Field.Size = 0;
+            InScratch = false;
+        }
+
+        CharT SeparatorChar;
+        CharT EscapeChar;
+        DSVRecordView<CharT> *Record;
+        std::basic_string<CharT> Scratch;
+        std::vector<Span> Spans;
+        Span Field;
+        bool InScratch;
+
+    };  // class Collector
+
+    const CharT *Begin;
+    const CharT *Current;
+    const CharT *End;
+    Collector Parser;
+
+};  // class DSVRecordReader
+
+}   // namespace libpt
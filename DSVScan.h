@@ -0,0 +1,206 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines functions that find DSV separators, escapes, and
+// newlines in contiguous ranges of characters.  DSVParser uses them to find
+// runs of ordinary field characters.  FindDSVNewline uses memchr for chars.
+//
+// The char versions are vectorized when the compiler targets AVX2, SSE2, or
+// NEON (as indicated by __AVX2__, __SSE2__, and __ARM_NEON, respectively)
+// and scan 32 or 16 characters at a time.  Other character types and
+// targets use a scalar loop.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace libpt {
+
+// Return a pointer to the first character in [begin, end) that is the
+// separator, the escape, or a newline.  Return end if there is none.
+// Passing the escape character as the separator finds the next escape
+// or newline.
+template <typename CharT>
+inline const CharT *FindDSVSpecial(const CharT *begin, const CharT *end,
+  CharT separator, CharT escape) {
+    assert(begin <= end);
+    for (; begin != end; ++begin) {
+        auto c = *begin;
+        if (c == separator || c == escape || c == '\n') {
+            break;
+        }
+    }
+    return begin;
+}
+
+namespace detail {
+
+// These supply the characters that FindDSVSpecialChars looks for.
+// Distinct is false if the separator and escape are known to be the same
+// character, which is then only compared once.
+struct RunTimeDSVChars {
+    static const bool Distinct = true;
+
+    RunTimeDSVChars(char separator, char escape)
+      : Separator(separator), Escape(escape) {}
+
+    char GetSeparator() const { return Separator; }
+    char GetEscape() const { return Escape; }
+
+    char Separator;
+    char Escape;
+};
+
+template <char Separator, char Escape>
+struct StaticDSVChars {
+    static const bool Distinct = Separator != Escape;
+
+    char GetSeparator() const { return Separator; }
+    char GetEscape() const { return Escape; }
+};
+
+// This is FindDSVSpecial for chars.  Each Chars type gets its own
+// instantiation, so StaticDSVChars' characters are built into it.
+template <typename Chars>
+inline const char *FindDSVSpecialChars(const char *begin, const char *end,
+  Chars chars) {
+    assert(begin <= end);
+#if defined(__AVX2__)
+    {
+        const __m256i separators = _mm256_set1_epi8(chars.GetSeparator());
+        const __m256i escapes = _mm256_set1_epi8(chars.GetEscape());
+        const __m256i newlines = _mm256_set1_epi8('\n');
+        while (end - begin >= 32) {
+            auto chunk = _mm256_loadu_si256(
+              reinterpret_cast<const __m256i *>(begin));
+            auto matches = _mm256_or_si256(
+              _mm256_cmpeq_epi8(chunk, separators),
+              _mm256_cmpeq_epi8(chunk, newlines));
+            if (Chars::Distinct) {
+                matches = _mm256_or_si256(matches,
+                  _mm256_cmpeq_epi8(chunk, escapes));
+            }
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+            if (mask) {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 32;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i separators = _mm_set1_epi8(chars.GetSeparator());
+        const __m128i escapes = _mm_set1_epi8(chars.GetEscape());
+        const __m128i newlines = _mm_set1_epi8('\n');
+        while (end - begin >= 16) {
+            auto chunk = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(begin));
+            auto matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, separators),
+              _mm_cmpeq_epi8(chunk, newlines));
+            if (Chars::Distinct) {
+                matches = _mm_or_si128(matches,
+                  _mm_cmpeq_epi8(chunk, escapes));
+            }
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+            if (mask) {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 16;
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        const uint8x16_t separators = vdupq_n_u8(chars.GetSeparator());
+        const uint8x16_t escapes = vdupq_n_u8(chars.GetEscape());
+        const uint8x16_t newlines = vdupq_n_u8('\n');
+        while (end - begin >= 16) {
+            auto chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(begin));
+            auto matches = vorrq_u8(vceqq_u8(chunk, separators),
+              vceqq_u8(chunk, newlines));
+            if (Chars::Distinct) {
+                matches = vorrq_u8(matches, vceqq_u8(chunk, escapes));
+            }
+
+            // Narrow each matching byte to four bits of a 64-bit mask.
+            auto mask = vget_lane_u64(vreinterpret_u64_u8(
+              vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+            if (mask) {
+                return begin + (__builtin_ctzll(mask) >> 2);
+            }
+            begin += 16;
+        }
+    }
+#endif
+    return FindDSVSpecial<char>(begin, end, chars.GetSeparator(),
+      chars.GetEscape());
+}
+
+}   // namespace detail
+
+inline const char *FindDSVSpecial(const char *begin, const char *end,
+  char separator, char escape) {
+    return detail::FindDSVSpecialChars(begin, end,
+      detail::RunTimeDSVChars(separator, escape));
+}
+
+// Return a pointer to the first newline in [begin, end) or end if there
+// is none.  The newline may be escaped: Callers must check.
+template <typename CharT>
+inline const CharT *FindDSVNewline(const CharT *begin, const CharT *end) {
+    assert(begin <= end);
+    return std::find(begin, end, CharT('\n'));
+}
+
+inline const char *FindDSVNewline(const char *begin, const char *end) {
+    assert(begin <= end);
+    auto newline = memchr(begin, '\n', static_cast<size_t>(end - begin));
+    return newline ? static_cast<const char *>(newline) : end;
+}
+
+namespace detail {
+
+template <typename CharT, CharT Separator, CharT Escape>
+struct StaticDSVSpecialFinder {
+    static const CharT *Find(const CharT *begin, const CharT *end) {
+        return FindDSVSpecial(begin, end, Separator, Escape);
+    }
+};
+
+template <char Separator, char Escape>
+struct StaticDSVSpecialFinder<char, Separator, Escape> {
+    static const char *Find(const char *begin, const char *end) {
+        return FindDSVSpecialChars(begin, end,
+          StaticDSVChars<Separator, Escape>());
+    }
+};
+
+}   // namespace detail
+
+// This is FindDSVSpecial for separators and escapes that are known at
+// compile time.  The comparison constants are built into the code, and if
+// Separator and Escape are the same, they're only compared once.
+template <typename CharT, CharT Separator, CharT Escape>
+inline const CharT *FindDSVSpecial(const CharT *begin, const CharT *end) {
+    return detail::StaticDSVSpecialFinder<CharT, Separator, Escape>::Find(
+      begin, end);
+}
+
+}   // namespace libpt
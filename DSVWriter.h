@@ -0,0 +1,277 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines classes for writing DSV records in the format that
+// DSVParser parses (see DSV.h).
+
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <DSV.h>
+#include <DSVScan.h>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// This class writes DSV records into a growable buffer, escaping
+// separators, escapes, and newlines within fields by preceding them with
+// the escape character.  Fields are scanned with FindDSVSpecial (see
+// DSVScan.h), so runs of ordinary characters are copied in bulk.
+//
+// This class uses the curiously recurring template pattern (CRTP).
+// Derived must define a method called OnOutput taking two const _CharT
+// pointers (begin and end), which is invoked with the buffered output
+// whenever at least flush_size characters (see the constructor) are
+// buffered and when Flush is called.  Derived must call Flush before it's
+// destroyed: DSVWriter's destructor can't.  The separator and escape
+// characters come from Delimiters, Derived's static constant Separator and
+// Escape members, or Derived's GetSeparator and GetEscape methods, as they
+// do for DSVParser.  (Inheriting UnixDSVParser supplies the UNIX ones.)
+//
+// Empty lines aren't records, so a record consisting of a single empty
+// field is written as an empty line and doesn't survive parsing.
+template <typename Derived, typename _CharT = char,
+  typename Delimiters = void>
+class DSVWriter {
+
+public:
+    typedef _CharT CharT;
+
+    static const size_t DefaultFlushSize = 64 * 1024;
+
+    DSVWriter(size_t flush_size = DefaultFlushSize)
+      : FlushSize(flush_size), InRecord(false) {
+        assert(this);
+        assert(flush_size > 0);
+        Buffer.reserve(flush_size);
+    }
+
+    DSVWriter(const DSVWriter &that) = delete;
+    DSVWriter &operator=(const DSVWriter &that) = delete;
+
+    // Write [begin, end) as the record's next field.
+    void WriteField(const CharT *begin, const CharT *end) {
+        assert(this);
+        assert(begin <= end);
+        if (InRecord) {
+            Buffer.push_back(GetSeparatorChar());
+        }
+        InRecord = true;
+        AppendEscaped(begin, end);
+        if (Buffer.size() >= FlushSize) {
+            Flush();
+        }
+    }
+
+    void WriteField(const std::basic_string<CharT> &field) {
+        assert(this);
+        WriteField(field.data(), field.data() + field.size());
+    }
+
+    // Write a null-terminated field.
+    void WriteField(const CharT *field) {
+        assert(this);
+        assert(field);
+        WriteField(field, field + std::char_traits<CharT>::length(field));
+    }
+
+    void WriteField(const DSVField<CharT> &field) {
+        assert(this);
+        WriteField(field.Data, field.Data + field.Size);
+    }
+
+    // Finish the current record.
+    void EndRecord() {
+        assert(this);
+        Buffer.push_back(CharT('\n'));
+        InRecord = false;
+        if (Buffer.size() >= FlushSize) {
+            Flush();
+        }
+    }
+
+    // Write a whole record.  This is compatible with DSVFieldCollector's
+    // OnRecord, so collected records can be written back out.
+    void WriteRecord(const DSVField<CharT> *fields, size_t field_count) {
+        assert(this);
+        assert(fields || field_count == 0);
+        for (size_t index = 0; index < field_count; ++index) {
+            WriteField(fields[index]);
+        }
+        EndRecord();
+    }
+
+    // Pass the buffered output to Derived.
+    void Flush() {
+        assert(this);
+        if (!Buffer.empty()) {
+            static_cast<Derived *>(this)->OnOutput(Buffer.data(),
+              Buffer.data() + Buffer.size());
+            Buffer.clear();
+        }
+    }
+
+    // Return true if fields have been written since the last EndRecord.
+    bool IsInRecord() const { assert(this); return InRecord; }
+
+    size_t GetBufferedSize() const { assert(this); return Buffer.size(); }
+
+private:
+    // These are the traits of the writer's delimiters.
+    template <typename D = Derived>
+    using DelimiterTraits = detail::DSVDelimiterTraits<CharT,
+      detail::StaticDSVDelimiterSource<CharT, Delimiters, D>>;
+
+    Derived *AsDerived() { return static_cast<Derived *>(this); }
+
+    CharT GetSeparatorChar() {
+        return GetSeparatorChar(typename DelimiterTraits<>::IsRunTime());
+    }
+
+    CharT GetSeparatorChar(std::true_type) {
+        return AsDerived()->GetSeparator();
+    }
+
+    CharT GetSeparatorChar(std::false_type) {
+        return DelimiterTraits<>::GetSeparator(CharT());
+    }
+
+    CharT GetEscapeChar() {
+        return GetEscapeChar(typename DelimiterTraits<>::IsRunTime());
+    }
+
+    CharT GetEscapeChar(std::true_type) { return AsDerived()->GetEscape(); }
+
+    CharT GetEscapeChar(std::false_type) {
+        return DelimiterTraits<>::GetEscape(CharT());
+    }
+
+    void AppendEscaped(const CharT *begin, const CharT *end) {
+        assert(this);
+        const CharT separator = GetSeparatorChar();
+        const CharT escape = GetEscapeChar();
+        while (true) {
+            auto special = DelimiterTraits<>::FindSpecial(begin, end,
+              separator, escape);
+            Buffer.insert(Buffer.end(), begin, special);
+            if (special == end) {
+                break;
+            }
+            Buffer.push_back(escape);
+            Buffer.push_back(*special);
+            begin = special + 1;
+        }
+    }
+
+    size_t FlushSize;
+    std::vector<CharT> Buffer;
+
+    // true if a field has been written since the last EndRecord
+    bool InRecord;
+
+};    // class DSVWriter
+
+// Instances of this class write DSV records to stdio FILEs with large
+// fwrite calls.  They don't own the FILEs.  Flush (which the destructor
+// calls) throws IOException if a write fails.  Delimiters is a DSVParser
+// delimiter policy.  If it's void (the default), the separator and escape
+// characters passed to the constructor are used; otherwise, they're fixed
+// at compile time (e.g., by UnixDSVDelimiters) and the constructor's are
+// ignored.
+template <typename Delimiters = void>
+class FileDSVWriter : public DSVWriter<FileDSVWriter<Delimiters>, char,
+  Delimiters> {
+
+public:
+    FileDSVWriter() = delete;
+    FileDSVWriter(FILE *file,
+      size_t flush_size = FileDSVWriter::DefaultFlushSize,
+      char separator = ':', char escape = '\\')
+      : DSVWriter<FileDSVWriter, char, Delimiters>(flush_size), File(file),
+        SeparatorChar(separator), EscapeChar(escape) {
+        assert(this);
+        assert(file);
+    }
+
+    // Destructors shouldn't throw, so call Flush first to detect errors.
+    ~FileDSVWriter() {
+        assert(this);
+        try {
+            this->Flush();
+        } catch (const IOException &) {
+        }
+    }
+
+    void OnOutput(const char *begin, const char *end) {
+        assert(this);
+        auto size = static_cast<size_t>(end - begin);
+        if (fwrite(begin, 1, size, File) != size) {
+            throw IOException(nullptr, errno);
+        }
+    }
+
+    char GetSeparator() const { assert(this); return SeparatorChar; }
+    char GetEscape() const { assert(this); return EscapeChar; }
+
+private:
+    FILE *File;
+    char SeparatorChar;
+    char EscapeChar;
+
+};    // class FileDSVWriter
+
+// Instances of this class append DSV records to strings.  Records are
+// buffered like any DSVWriter's, so call Flush before reading the string.
+// Delimiters is treated as it is by FileDSVWriter.
+template <typename _CharT = char, typename Delimiters = void>
+class StringDSVWriter : public DSVWriter<StringDSVWriter<_CharT,
+  Delimiters>, _CharT, Delimiters> {
+
+public:
+    typedef _CharT CharT;
+
+    StringDSVWriter() = delete;
+    StringDSVWriter(std::basic_string<CharT> *output,
+      size_t flush_size = StringDSVWriter::DefaultFlushSize,
+      CharT separator = ':', CharT escape = '\\')
+      : DSVWriter<StringDSVWriter, CharT, Delimiters>(flush_size),
+        Output(output), SeparatorChar(separator), EscapeChar(escape) {
+        assert(this);
+        assert(output);
+    }
+
+    ~StringDSVWriter() {
+        assert(this);
+        this->Flush();
+    }
+
+    void OnOutput(const CharT *begin, const CharT *end) {
+        assert(this);
+        Output->append(begin, end);
+    }
+
+    CharT GetSeparator() const { assert(this); return SeparatorChar; }
+    CharT GetEscape() const { assert(this); return EscapeChar; }
+
+private:
+    std::basic_string<CharT> *Output;
+    CharT SeparatorChar;
+    CharT EscapeChar;
+
+};    // class StringDSVWriter
+
+}   // namespace libpt
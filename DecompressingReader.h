@@ -0,0 +1,333 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines readers that decompress the blocks of other readers.
+// libpt parsers can use them in templated parsing functions.  GzipReader
+// is defined if zlib's header is available and ZstdReader is defined if
+// zstd's is; programs using them must be linked with -lz and -lzstd,
+// respectively.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <Exceptions.h>
+
+#if defined(__has_include)
+#if __has_include(<zlib.h>)
+#define LIBPT_ZLIB 1
+#include <zlib.h>
+#endif
+#if __has_include(<zstd.h>)
+#define LIBPT_ZSTD 1
+#include <zstd.h>
+#endif
+#endif
+
+namespace libpt {
+
+// This class implements the reader interface (ReadChar, TryReadChar,
+// ReadBlock, IsEOF, and Error) for readers that decompress the blocks
+// of a Source reader, which must implement ReadBlock (see DSVParser::Parse).
+// It uses the curiously recurring template pattern (CRTP): Derived must
+// define a method called Decompress taking a char pointer and a size and
+// returning a size_t, which decompresses up to size bytes into the
+// pointed-to buffer and returns how many it produced.  Decompress must
+// produce at least one byte unless the stream has ended or failed, and
+// it gets compressed data with ReadInput.  It calls SetError if the data
+// is corrupt or truncated.
+//
+// Decompressed data goes into one reusable buffer of block_size bytes, so
+// ReadBlock's blocks remain valid until the next call to ReadBlock,
+// ReadChar, or TryReadChar that needs a new block.  The readers don't own
+// their sources: Others must keep them alive while they're used.
+template <typename Derived, typename Source>
+class DecompressingReader {
+
+public:
+    static const size_t DefaultBlockSize = 256 * 1024;
+
+    DecompressingReader() = delete;
+    DecompressingReader(const DecompressingReader &that) = delete;
+    DecompressingReader &operator=(const DecompressingReader &that) = delete;
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !Fill()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !Fill()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !Fill()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return AtEnd && Current == End; }
+
+    // Return true if the compressed data was corrupt or truncated.
+    inline bool Error() { assert(this); return Failed; }
+
+    Source *GetSource() const { assert(this); return Input; }
+
+protected:
+    DecompressingReader(Source *source, size_t block_size)
+      : Input(source), Output(block_size), Current(nullptr), End(nullptr),
+        AtEnd(false), Failed(false) {
+        assert(this);
+        assert(source);
+        assert(block_size > 0);
+    }
+
+    // Point *input at the source's next block of compressed data and
+    // return its size, which is zero at the end of the source.
+    size_t ReadInput(const char **input) {
+        assert(this);
+        assert(input);
+        return Input->ReadBlock(input);
+    }
+
+    void SetError() { assert(this); Failed = true; }
+
+private:
+    bool Fill() {
+        assert(this);
+        if (AtEnd) {
+            return false;
+        }
+        auto size = static_cast<Derived *>(this)->Decompress(Output.data(),
+          Output.size());
+        Current = Output.data();
+        End = Current + size;
+        if (size == 0) {
+            AtEnd = true;
+            return false;
+        }
+        return true;
+    }
+
+    Source *Input;
+    std::vector<char> Output;
+
+    // the unread part of the output buffer
+    const char *Current;
+    const char *End;
+
+    bool AtEnd;
+    bool Failed;
+
+};  // class DecompressingReader
+
+#if defined(LIBPT_ZLIB)
+
+// Instances of this class decompress gzip (or zlib) data from Source
+// readers.  Concatenated gzip members are decompressed one after another,
+// as gzip does.
+template <typename Source>
+class GzipReader : public DecompressingReader<GzipReader<Source>, Source> {
+
+public:
+    GzipReader() = delete;
+
+    // This throws std::bad_alloc if zlib can't allocate its state.
+    GzipReader(Source *source,
+      size_t block_size = GzipReader::DefaultBlockSize)
+      : DecompressingReader<GzipReader, Source>(source, block_size),
+        Pending(nullptr), PendingSize(0), SourceEnded(false),
+        InMember(false) {
+        assert(this);
+        Stream.zalloc = Z_NULL;
+        Stream.zfree = Z_NULL;
+        Stream.opaque = Z_NULL;
+        Stream.next_in = Z_NULL;
+        Stream.avail_in = 0;
+
+        // 32 makes zlib detect gzip and zlib headers.
+        if (inflateInit2(&Stream, 15 + 32) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~GzipReader() {
+        assert(this);
+        inflateEnd(&Stream);
+    }
+
+private:
+    friend class DecompressingReader<GzipReader, Source>;
+
+    size_t Decompress(char *output, size_t size) {
+        assert(this);
+        assert(output);
+        size = std::min<size_t>(size, UINT_MAX);
+        Stream.next_out = reinterpret_cast<Bytef *>(output);
+        Stream.avail_out = static_cast<uInt>(size);
+        while (Stream.avail_out == size) {
+            if (Stream.avail_in == 0) {
+                FeedInput();
+            }
+            auto result = inflate(&Stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                InMember = false;
+                inflateReset(&Stream);
+            } else if (result == Z_OK) {
+                InMember = true;
+            } else if (result != Z_BUF_ERROR || Stream.avail_in != 0) {
+                this->SetError();
+                break;
+            } else if (SourceEnded) {
+                // zlib made no progress and there's no more input.
+                if (InMember) {
+                    this->SetError();
+                }
+                break;
+            }
+        }
+        return size - Stream.avail_out;
+    }
+
+    // Give zlib more of the source's data.  avail_in is an unsigned int,
+    // so blocks larger than that are fed in pieces.
+    void FeedInput() {
+        assert(this);
+        if (PendingSize == 0 && !SourceEnded) {
+            PendingSize = this->ReadInput(&Pending);
+            SourceEnded = PendingSize == 0;
+        }
+        auto size = std::min<size_t>(PendingSize, UINT_MAX);
+        Stream.next_in = reinterpret_cast<Bytef *>(
+          const_cast<char *>(Pending));
+        Stream.avail_in = static_cast<uInt>(size);
+        Pending += size;
+        PendingSize -= size;
+    }
+
+    z_stream Stream;
+
+    // the part of the source's current block that zlib hasn't seen yet
+    const char *Pending;
+    size_t PendingSize;
+
+    bool SourceEnded;
+
+    // true if zlib is in the middle of a gzip member
+    bool InMember;
+
+};  // class GzipReader
+
+#endif
+
+#if defined(LIBPT_ZSTD)
+
+// Instances of this class decompress zstd data from Source readers.
+// Concatenated frames are decompressed one after another.
+template <typename Source>
+class ZstdReader : public DecompressingReader<ZstdReader<Source>, Source> {
+
+public:
+    ZstdReader() = delete;
+
+    // The default block size is zstd's recommended output size.  This
+    // throws std::bad_alloc if zstd can't allocate its state.
+    ZstdReader(Source *source, size_t block_size = ZSTD_DStreamOutSize())
+      : DecompressingReader<ZstdReader, Source>(source, block_size),
+        Stream(ZSTD_createDStream()), SourceEnded(false), InFrame(false) {
+        assert(this);
+        if (!Stream) {
+            throw std::bad_alloc();
+        }
+        if (ZSTD_isError(ZSTD_initDStream(Stream))) {
+            ZSTD_freeDStream(Stream);
+            throw std::bad_alloc();
+        }
+        Input.src = nullptr;
+        Input.size = Input.pos = 0;
+    }
+
+    ~ZstdReader() {
+        assert(this);
+        ZSTD_freeDStream(Stream);
+    }
+
+private:
+    friend class DecompressingReader<ZstdReader, Source>;
+
+    size_t Decompress(char *output, size_t size) {
+        assert(this);
+        assert(output);
+        ZSTD_outBuffer buffer = { output, size, 0 };
+        while (buffer.pos == 0) {
+            if (Input.pos == Input.size && !SourceEnded) {
+                const char *block;
+                Input.size = this->ReadInput(&block);
+                Input.src = block;
+                Input.pos = 0;
+                SourceEnded = Input.size == 0;
+            }
+
+            // With no input left, this flushes whatever zstd still holds.
+            // Between frames, zstd returns the size of the next frame's
+            // header, so a frame is only in progress once input is used.
+            auto position = Input.pos;
+            auto result = ZSTD_decompressStream(Stream, &buffer, &Input);
+            if (ZSTD_isError(result)) {
+                this->SetError();
+                break;
+            } else if (result == 0) {
+                InFrame = false;
+            } else if (Input.pos != position || buffer.pos != 0) {
+                InFrame = true;
+            }
+            if (SourceEnded && buffer.pos == 0) {
+                if (InFrame) {
+                    this->SetError();
+                }
+                break;
+            }
+        }
+        return buffer.pos;
+    }
+
+    ZSTD_DStream *Stream;
+    ZSTD_inBuffer Input;
+    bool SourceEnded;
+
+    // true if zstd is in the middle of a frame
+    bool InFrame;
+
+};  // class ZstdReader
+
+#endif
+
+}   // namespace libpt
@@ -0,0 +1,272 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for reading characters from file descriptors
+// through a large buffer with read().  libpt parsers can use it in
+// templated parsing functions.  It requires POSIX.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// Instances of this class read bytes from file descriptors into a buffer
+// of block_size bytes (see the constructors) with read() and supply them
+// one at a time (ReadChar and TryReadChar) or a buffer at a time
+// (ReadBlock).  Unlike FileReaders, they don't go through stdio, so reading
+// a character is an inline pointer comparison in the common case.  Blocks
+// remain valid until the next call to ReadBlock, ReadChar, or TryReadChar
+// that needs to refill the buffer.
+//
+// The options are a bitwise OR of the following:
+//
+//     * Sequential, which advises the kernel that the file will be read
+//       sequentially (with posix_fadvise) so that it reads ahead more
+//     * Direct, which opens the file with O_DIRECT (or sets O_DIRECT on
+//       the descriptor) so that reads bypass the page cache; the buffer
+//       is aligned and its size rounded up as O_DIRECT requires, and the
+//       reader falls back to ordinary reads if the file system or the
+//       descriptor's position doesn't allow direct reads
+//
+// Read errors end the stream; Error and GetErrno report them.
+// DescriptorReaders are movable but not copyable.
+class DescriptorReader {
+
+public:
+    static const size_t DefaultBlockSize = 1024 * 1024;
+    static const int Sequential = 1;
+    static const int Direct = 2;
+
+    // O_DIRECT buffers, sizes, and offsets are multiples of this.
+    static const size_t DirectAlignment = 4096;
+
+    DescriptorReader() = delete;
+
+    // Open the file at the specified path.  This throws FileOpenException
+    // if the file can't be opened.  The descriptor is closed when the
+    // reader is destroyed.
+    DescriptorReader(const char *path, size_t block_size = DefaultBlockSize,
+      int options = 0)
+      : Descriptor(-1), OwnsDescriptor(true) {
+        assert(this);
+        assert(path);
+#if defined(O_DIRECT)
+        if (options & Direct) {
+            Descriptor = open(path, O_RDONLY | O_DIRECT);
+        }
+#endif
+        if (Descriptor == -1) {
+            Descriptor = open(path, O_RDONLY);
+            if (Descriptor == -1) {
+                throw FileOpenException(path, errno);
+            }
+            options &= ~Direct;
+        }
+        Start(block_size, options);
+    }
+
+    // Read the file descriptor fd from its current position.  The
+    // descriptor isn't closed: Its management is left to others.  If
+    // options includes Direct, O_DIRECT is set on the descriptor.
+    DescriptorReader(int fd, size_t block_size = DefaultBlockSize,
+      int options = 0)
+      : Descriptor(fd), OwnsDescriptor(false) {
+        assert(this);
+        assert(fd >= 0);
+#if defined(O_DIRECT)
+        if (options & Direct) {
+            auto flags = fcntl(fd, F_GETFL);
+            if (flags == -1 || fcntl(fd, F_SETFL, flags | O_DIRECT) == -1) {
+                options &= ~Direct;
+            }
+        }
+#endif
+        Start(block_size, options);
+    }
+
+    DescriptorReader(const DescriptorReader &that) = delete;
+    DescriptorReader &operator=(const DescriptorReader &that) = delete;
+
+    DescriptorReader(DescriptorReader &&that)
+      : Descriptor(that.Descriptor), OwnsDescriptor(that.OwnsDescriptor),
+        Options(that.Options), Buffer(that.Buffer),
+        BlockSize(that.BlockSize), Current(that.Current), End(that.End),
+        AtEnd(that.AtEnd), ErrorValue(that.ErrorValue) {
+        assert(this);
+        assert(&that);
+        that.Descriptor = -1;
+        that.OwnsDescriptor = false;
+        that.Buffer = nullptr;
+        that.Current = that.End = nullptr;
+    }
+
+    ~DescriptorReader() {
+        assert(this);
+        free(Buffer);
+        if (OwnsDescriptor) {
+            close(Descriptor);
+        }
+    }
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !Fill()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !Fill()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !Fill()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return AtEnd && Current == End; }
+    inline bool Error() { assert(this); return ErrorValue != 0; }
+
+    // Return the errno value of the read that failed or zero if none did.
+    inline int GetErrno() const { assert(this); return ErrorValue; }
+
+    // Return the options in effect, which lack Direct if direct reads
+    // weren't possible.
+    inline int GetOptions() const { assert(this); return Options; }
+
+    inline size_t GetBlockSize() const { assert(this); return BlockSize; }
+
+    // Continue reading at the specified offset from the start of the
+    // file.  Direct readers read from the preceding aligned offset and
+    // skip the difference.  This throws IOException if the descriptor
+    // isn't seekable.
+    void Seek(uint64_t offset) {
+        assert(this);
+        auto skip = (Options & Direct) ? offset % DirectAlignment : 0;
+        if (lseek(Descriptor, static_cast<off_t>(offset - skip), SEEK_SET) ==
+          -1) {
+            throw IOException(nullptr, errno);
+        }
+        AtEnd = false;
+        ErrorValue = 0;
+        Current = End = Buffer;
+        if (skip != 0 && Fill()) {
+            Current += std::min<size_t>(skip, End - Current);
+        }
+    }
+
+private:
+    void Start(size_t block_size, int options) {
+        assert(this);
+        assert(block_size > 0);
+        Options = options;
+        BlockSize = block_size;
+        Current = End = Buffer = nullptr;
+        AtEnd = false;
+        ErrorValue = 0;
+        if (Options & Direct) {
+            BlockSize = (BlockSize + DirectAlignment - 1) / DirectAlignment *
+              DirectAlignment;
+        }
+        void *buffer;
+        if (posix_memalign(&buffer, DirectAlignment, BlockSize) != 0) {
+            if (OwnsDescriptor) {
+                close(Descriptor);
+            }
+            throw std::bad_alloc();
+        }
+        Buffer = static_cast<char *>(buffer);
+        Current = End = Buffer;
+#if defined(POSIX_FADV_SEQUENTIAL)
+        if (Options & Sequential) {
+            posix_fadvise(Descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif
+    }
+
+    // Refill the buffer.  Return false at the end of the stream.
+    bool Fill() {
+        assert(this);
+        if (AtEnd) {
+            return false;
+        }
+        ssize_t size;
+        while ((size = read(Descriptor, Buffer, BlockSize)) == -1) {
+            if (errno == EINVAL && (Options & Direct)) {
+                // The position or the file system doesn't allow direct
+                // reads, so read normally.
+                DisableDirect();
+            } else if (errno != EINTR) {
+                ErrorValue = errno;
+                break;
+            }
+        }
+        if (size <= 0) {
+            AtEnd = true;
+            Current = End = Buffer;
+            return false;
+        }
+        Current = Buffer;
+        End = Buffer + size;
+        return true;
+    }
+
+    void DisableDirect() {
+        assert(this);
+        Options &= ~Direct;
+#if defined(O_DIRECT)
+        auto flags = fcntl(Descriptor, F_GETFL);
+        if (flags != -1) {
+            fcntl(Descriptor, F_SETFL, flags & ~O_DIRECT);
+        }
+#endif
+    }
+
+    int Descriptor;
+    bool OwnsDescriptor;
+    int Options;
+    char *Buffer;
+    size_t BlockSize;
+
+    // the unread part of the buffer
+    const char *Current;
+    const char *End;
+
+    bool AtEnd;
+    int ErrorValue;
+
+};  // class DescriptorReader
+
+}   // namespace libpt
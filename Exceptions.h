@@ -20,7 +20,7 @@ namespace libpt {
 class OSException {
 
 public:
-    OSException(int errno) : Errno(errno) {}
+    OSException(int errno_value) : Errno(errno_value) {}
 
     int GetErrno() const { assert(this); return Errno; }
 
@@ -14,7 +14,11 @@
 
 #pragma once
 
+#include <cerrno>
+#include <climits>
+#include <cstdint>
 #include <cstdio>
+#include <vector>
 #include <Exceptions.h>
 
 namespace libpt {
@@ -22,12 +26,20 @@ namespace libpt {
 // Instances of this class read bytes from stdio FILEs.  They don't own the
 // FILEs (i.e., they don't open or close them): Their management is left
 // to others.
+//
+// ReadBlock reads up to block_size bytes (see the constructor) into an
+// internal buffer with fread and points its parameter at them.  The
+// block remains valid until the next call to ReadBlock.
 class FileReader {
 
 public:
+    static const size_t DefaultBlockSize = 64 * 1024;
+
     FileReader() = delete;
-    FileReader(FILE *file) : File(file) {
+    FileReader(FILE *file, size_t block_size = DefaultBlockSize)
+      : File(file), BlockSize(block_size) {
         assert(file);
+        assert(block_size > 0);
     }
 
     inline char ReadChar() {
@@ -39,11 +51,49 @@ public:
         return c;
     }
 
+    // This is like ReadChar except that it stores the character in *c
+    // and returns false instead of throwing EOFException at the end of
+    // the stream.
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        auto value = getc(File);
+        if (value == -1) {
+            return false;
+        }
+        *c = value;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        Buffer.resize(BlockSize);
+        auto size = fread(Buffer.data(), 1, Buffer.size(), File);
+        *block = Buffer.data();
+        return size;
+    }
+
     inline bool IsEOF() { assert(this); return feof(File) != 0; }
     inline bool Error() { assert(this); return ferror(File) != 0; }
 
+    // Continue reading at the specified offset from the start of the
+    // file.  This throws IOException if the FILE isn't seekable or the
+    // offset is too large for fseek.
+    void Seek(uint64_t offset) {
+        assert(this);
+        if (offset > static_cast<uint64_t>(LONG_MAX)) {
+            throw IOException(nullptr, EOVERFLOW);
+        }
+        if (fseek(File, static_cast<long>(offset), SEEK_SET) != 0) {
+            throw IOException(nullptr, errno);
+        }
+    }
+
 private:
     FILE *File;
+    size_t BlockSize;
+    std::vector<char> Buffer;
 
 };  // class FileReader
 
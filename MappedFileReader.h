@@ -0,0 +1,174 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for reading characters from memory-mapped
+// files.  libpt parsers can use it in templated parsing functions.
+// It requires POSIX mmap.
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// Instances of this class map entire files into memory (read-only) and
+// supply their bytes.  Unlike FileReaders, they own their mappings, which
+// they unmap when they're destroyed.  They're movable but not copyable.
+//
+// Because the whole file is contiguous in memory, ReadBlock returns all
+// of the remaining bytes as a single block, and GetData and GetSize
+// expose the mapping directly.  The mapping is advised for sequential
+// access.  Modifying or truncating a file while it's mapped has undefined
+// results.
+class MappedFileReader {
+
+public:
+    MappedFileReader() = delete;
+
+    // Map the file at the specified path.  This throws FileOpenException
+    // if the file can't be opened or examined and IOException if it can't
+    // be mapped.  The file descriptor is closed before this returns.
+    MappedFileReader(const char *path) : Data(nullptr), Size(0) {
+        assert(this);
+        assert(path);
+        auto fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            throw FileOpenException(path, errno);
+        }
+        try {
+            Map(fd, path);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+    // Map the file open for reading on the specified file descriptor.
+    // The descriptor isn't closed: Its management is left to others.
+    MappedFileReader(int fd) : Data(nullptr), Size(0) {
+        assert(this);
+        assert(fd >= 0);
+        Map(fd, nullptr);
+    }
+
+    MappedFileReader(const MappedFileReader &that) = delete;
+    MappedFileReader &operator=(const MappedFileReader &that) = delete;
+
+    MappedFileReader(MappedFileReader &&that)
+      : Data(that.Data), Size(that.Size), Current(that.Current),
+        End(that.End) {
+        assert(this);
+        assert(&that);
+        that.Data = that.Current = that.End = nullptr;
+        that.Size = 0;
+    }
+
+    ~MappedFileReader() {
+        assert(this);
+        Unmap();
+    }
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return Current == End; }
+
+    // Mapping errors are reported by the constructors, so this is always
+    // false.
+    inline bool Error() { assert(this); return false; }
+
+    inline void Rewind() {
+        assert(this);
+        Current = Data;
+    }
+
+    // Continue reading at the specified offset from the start of the
+    // file.  Offsets beyond the end of the file move to the end.
+    inline void Seek(uint64_t offset) {
+        assert(this);
+        Current = Data + (offset < Size ? static_cast<size_t>(offset) : Size);
+    }
+
+    // These return the start of the mapping and its size.  The data is
+    // null if the file is empty.
+    inline const char *GetData() const { assert(this); return Data; }
+    inline size_t GetSize() const { assert(this); return Size; }
+
+private:
+    void Map(int fd, const char *source) {
+        assert(this);
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            throw FileOpenException(source, errno);
+        }
+        Size = static_cast<size_t>(info.st_size);
+        if (Size != 0) {
+            auto address = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                Size = 0;
+                throw IOException(source, errno);
+            }
+            Data = static_cast<const char *>(address);
+            madvise(address, Size, MADV_SEQUENTIAL);
+        }
+        Current = Data;
+        End = Data + Size;
+    }
+
+    void Unmap() {
+        assert(this);
+        if (Data) {
+            munmap(const_cast<char *>(Data), Size);
+        }
+        Data = Current = End = nullptr;
+        Size = 0;
+    }
+
+    const char *Data;
+    size_t Size;
+    const char *Current;
+    const char *End;
+
+};  // class MappedFileReader
+
+}   // namespace libpt
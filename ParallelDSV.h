@@ -0,0 +1,351 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines functions and classes for parsing large, contiguous
+// DSV inputs (such as MappedFileReaders' mappings) on several threads.
+// Programs using it must be linked with the platform's thread library
+// (e.g., -pthread).
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <Arena.h>
+#include <DSV.h>
+#include <DSVScan.h>
+
+namespace libpt {
+
+// Return a pointer to the first character after the first unescaped newline
+// at or after position, or end if there is none.  begin must be the start
+// of the input or a record boundary, and begin <= position <= end.
+//
+// A newline is escaped if and only if it's preceded by an odd number of
+// consecutive escape characters, so only the escapes immediately before
+// each candidate newline are examined.
+template <typename CharT>
+const CharT *FindDSVRecordBoundary(const CharT *begin, const CharT *position,
+  const CharT *end, CharT escape) {
+    assert(begin <= position);
+    assert(position <= end);
+    while (true) {
+        auto newline = FindDSVNewline(position, end);
+        if (newline == end) {
+            return end;
+        }
+        size_t escapes = 0;
+        for (auto c = newline; c != begin && c[-1] == escape; --c) {
+            ++escapes;
+        }
+        if (escapes % 2 == 0) {
+            return newline + 1;
+        }
+        position = newline + 1;
+    }
+}
+
+// Split [begin, end) into at most chunk_count ranges that start and end at
+// record boundaries.  The result holds the ranges' boundaries in order:
+// Range i is [result[i], result[i + 1]).  The first boundary is begin and
+// the last is end.  Ranges are roughly equal in size, but there are fewer
+// of them if records are very long.
+template <typename CharT>
+std::vector<const CharT *> SplitDSVChunks(const CharT *begin,
+  const CharT *end, size_t chunk_count, CharT escape) {
+    assert(begin <= end);
+    assert(chunk_count > 0);
+    std::vector<const CharT *> boundaries(1, begin);
+    auto size = static_cast<size_t>(end - begin);
+    for (size_t index = 1; index < chunk_count; ++index) {
+        auto nominal = begin + size / chunk_count * index;
+        auto position = std::max(nominal, boundaries.back());
+        if (position == end) {
+            break;
+        }
+        auto boundary = FindDSVRecordBoundary(begin, position, end, escape);
+        if (boundary == end) {
+            break;
+        }
+        if (boundary != boundaries.back()) {
+            boundaries.push_back(boundary);
+        }
+    }
+    boundaries.push_back(end);
+    return boundaries;
+}
+
+// This determines the order in which ParallelDSVParser delivers records.
+enum class DSVRecordOrder {
+    // Records are delivered in the order in which they appear in the input.
+    InOrder,
+
+    // Chunks are delivered as soon as they're parsed, so chunks' records
+    // may be delivered out of order, but each chunk's records are
+    // delivered in order.
+    Unordered
+};
+
+// Instances of this class split contiguous DSV inputs into chunks at record
+// boundaries (see SplitDSVChunks) and parse the chunks on worker threads.
+// Each chunk is parsed by a DSVParser that starts in its initial state,
+// which is exactly the parser's state at a record boundary, so the results
+// are the same as parsing the whole input sequentially.
+//
+// Workers copy each chunk's records into the chunk's Arena (see
+// DSVFieldCollector) and the calling thread delivers them to the consumer,
+// so consumers needn't be thread-safe.  At most twice as many chunks as
+// there are threads are parsed ahead of the consumer, and their arenas are
+// reused, so memory use doesn't grow with the size of the input.
+//
+// Delimiters is a DSVParser delimiter policy.  If it's void (the default),
+// the separator and escape characters passed to the constructor are used;
+// otherwise, they're fixed at compile time (e.g., by UnixDSVDelimiters)
+// and the constructor's are ignored.
+template <typename _CharT = char, typename Delimiters = void>
+class ParallelDSVParser {
+
+public:
+    typedef _CharT CharT;
+
+    // thread_count is the number of worker threads (zero means one per
+    // hardware thread).  chunk_count is the number of chunks that inputs
+    // are split into (zero means four per thread).
+    ParallelDSVParser(size_t thread_count = 0, size_t chunk_count = 0,
+      CharT separator = ':', CharT escape = '\\')
+      : ThreadCount(thread_count), ChunkCount(chunk_count),
+        SeparatorChar(separator), EscapeChar(escape) {
+        assert(this);
+        if (ThreadCount == 0) {
+            ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (ChunkCount == 0) {
+            ChunkCount = ThreadCount * 4;
+        }
+    }
+
+    ParallelDSVParser(const ParallelDSVParser &that) = delete;
+    ParallelDSVParser &operator=(const ParallelDSVParser &that) = delete;
+
+    size_t GetThreadCount() const { assert(this); return ThreadCount; }
+    size_t GetChunkCount() const { assert(this); return ChunkCount; }
+
+    // Parse [begin, end) and pass each record to consumer's OnRecord
+    // method, which takes a const DSVField<CharT> pointer to the record's
+    // fields and the number of fields.  The fields are only valid during
+    // the call.  OnRecord is only called on the calling thread.  If a
+    // worker or the consumer throws an exception, the workers are stopped
+    // and the exception is rethrown.
+    template <typename Consumer>
+    void Parse(const CharT *begin, const CharT *end, Consumer &consumer,
+      DSVRecordOrder order = DSVRecordOrder::InOrder) {
+        assert(this);
+        assert(begin <= end);
+        assert(&consumer);
+        Job job(*this, begin, end);
+        std::vector<std::thread> workers;
+        try {
+            auto worker_count = std::min(ThreadCount, job.GetChunkCount());
+            for (size_t index = 0; index < worker_count; ++index) {
+                workers.emplace_back([&job]() { job.Work(); });
+            }
+            job.Deliver(consumer, order);
+        } catch (...) {
+            job.Stop();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            throw;
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    typedef detail::DSVDelimiterTraits<CharT, Delimiters> DelimiterTraits;
+
+    CharT GetSeparatorChar() const {
+        return DelimiterTraits::GetSeparator(SeparatorChar);
+    }
+
+    CharT GetEscapeChar() const {
+        return DelimiterTraits::GetEscape(EscapeChar);
+    }
+
+    struct Record {
+        const DSVField<CharT> *Fields;
+        size_t FieldCount;
+    };
+
+    // This holds a parsed chunk's records until they're delivered.
+    struct Slot {
+        Slot() : Chunk(0), Done(false) {}
+
+        Arena Storage;
+        std::vector<Record> Records;
+        size_t Chunk;
+        bool Done;
+    };
+
+    class ChunkCollector : public DSVFieldCollector<ChunkCollector, CharT,
+      Delimiters> {
+
+    public:
+        ChunkCollector(Slot *slot, CharT separator, CharT escape)
+          : DSVFieldCollector<ChunkCollector, CharT, Delimiters>(
+              &slot->Storage),
+            Records(&slot->Records), SeparatorChar(separator),
+            EscapeChar(escape) {}
+
+        void OnRecord(const DSVField<CharT> *fields, size_t field_count) {
+            Record record = { fields, field_count };
+            Records->push_back(record);
+        }
+
+        CharT GetSeparator() const { return SeparatorChar; }
+        CharT GetEscape() const { return EscapeChar; }
+
+    private:
+        std::vector<Record> *Records;
+        CharT SeparatorChar;
+        CharT EscapeChar;
+
+    };  // class ChunkCollector
+
+    // This is the state shared by the workers and the delivering thread
+    // during a single call to Parse.
+    class Job {
+
+    public:
+        Job(const ParallelDSVParser &parser, const CharT *begin,
+          const CharT *end)
+          : Parser(parser), NextChunk(0), Stopped(false) {
+            Boundaries = SplitDSVChunks(begin, end, parser.ChunkCount,
+              parser.GetEscapeChar());
+            Slots.resize(std::min(GetChunkCount(), parser.ThreadCount * 2));
+            for (auto &slot : Slots) {
+                FreeSlots.push_back(&slot);
+            }
+        }
+
+        size_t GetChunkCount() const { return Boundaries.size() - 1; }
+
+        void Work() {
+            while (true) {
+                Slot *slot;
+                {
+                    std::unique_lock<std::mutex> lock(Mutex);
+                    Changed.wait(lock, [this]() {
+                        return Stopped || NextChunk == GetChunkCount() ||
+                          !FreeSlots.empty();
+                    });
+                    if (Stopped || NextChunk == GetChunkCount()) {
+                        return;
+                    }
+                    slot = FreeSlots.back();
+                    FreeSlots.pop_back();
+                    slot->Chunk = NextChunk++;
+                }
+                try {
+                    ChunkCollector collector(slot, Parser.GetSeparatorChar(),
+                      Parser.GetEscapeChar());
+                    collector.FeedCharacters(Boundaries[slot->Chunk],
+                      Boundaries[slot->Chunk + 1]);
+                    collector.FinishParsing();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(Mutex);
+                    if (!Error) {
+                        Error = std::current_exception();
+                    }
+                    Stopped = true;
+                    Changed.notify_all();
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(Mutex);
+                slot->Done = true;
+                Changed.notify_all();
+            }
+        }
+
+        template <typename Consumer>
+        void Deliver(Consumer &consumer, DSVRecordOrder order) {
+            for (size_t delivered = 0; delivered < GetChunkCount();
+              ++delivered) {
+                Slot *slot = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(Mutex);
+                    Changed.wait(lock, [&]() {
+                        slot = FindDeliverableSlot(delivered, order);
+                        return Stopped || slot;
+                    });
+                    if (Error) {
+                        std::rethrow_exception(Error);
+                    }
+                    if (!slot) {
+                        return;
+                    }
+                }
+                for (const auto &record : slot->Records) {
+                    consumer.OnRecord(record.Fields, record.FieldCount);
+                }
+                slot->Records.clear();
+                slot->Storage.Reset();
+                std::lock_guard<std::mutex> lock(Mutex);
+                slot->Done = false;
+                FreeSlots.push_back(slot);
+                Changed.notify_all();
+            }
+        }
+
+        void Stop() {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stopped = true;
+            Changed.notify_all();
+        }
+
+    private:
+        Slot *FindDeliverableSlot(size_t delivered, DSVRecordOrder order) {
+            for (auto &slot : Slots) {
+                if (slot.Done && (order == DSVRecordOrder::Unordered ||
+                  slot.Chunk == delivered)) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
+
+        const ParallelDSVParser &Parser;
+        std::vector<const CharT *> Boundaries;
+        std::vector<Slot> Slots;
+        std::vector<Slot *> FreeSlots;
+        size_t NextChunk;
+        bool Stopped;
+        std::exception_ptr Error;
+        std::mutex Mutex;
+        std::condition_variable Changed;
+
+    };  // class Job
+
+    size_t ThreadCount;
+    size_t ChunkCount;
+    CharT SeparatorChar;
+    CharT EscapeChar;
+
+};  // class ParallelDSVParser
+
+}   // namespace libpt
@@ -0,0 +1,311 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for parsing many DSV files on several
+// threads.  It requires POSIX, and programs using it must be linked with
+// the platform's thread library (e.g., -pthread).
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <DescriptorReader.h>
+#include <Exceptions.h>
+#include <MappedFileReader.h>
+
+namespace libpt {
+
+// Instances of this class parse lists of files on worker threads, each of
+// which parses whole files with its own Handler, a DSVParser (see DSV.h).
+// Files are dealt to the workers largest first, and workers that run out
+// of files steal them from the others, so a few large files don't leave
+// most threads idle and small files don't wait behind large ones.
+//
+// Regular files of at least map_threshold bytes (see the constructor) are
+// parsed with MappedFileReaders; other files are read with
+// DescriptorReaders, whose buffers are no larger than the files.
+//
+// Each file is parsed from the handler's initial state: The worker calls
+// the handler's Reset method before each file and FinishParsing after it.
+// Handler may define the following methods, which are called on the
+// handler's worker thread:
+//
+//     * OnFileStart, taking a const char pointer to the file's path, which
+//       is called before the file is opened
+//     * OnFileEnd, taking the same, which is called after FinishParsing
+//
+// It may also define a method called Merge taking a Handler reference,
+// which Parse calls on the calling thread after the workers finish to
+// merge the other handlers' results into the first handler.  Which
+// handler parses which file, and the order in which each handler's
+// files are parsed, are unspecified.
+class ParallelDSVFileParser {
+
+public:
+    static const size_t DefaultMapThreshold = 1024 * 1024;
+
+    // thread_count is the number of worker threads (zero means one per
+    // hardware thread).  Files are read through buffers of up to
+    // block_size bytes unless they're mapped.
+    ParallelDSVFileParser(size_t thread_count = 0,
+      size_t map_threshold = DefaultMapThreshold,
+      size_t block_size = DescriptorReader::DefaultBlockSize)
+      : ThreadCount(thread_count), MapThreshold(map_threshold),
+        BlockSize(block_size) {
+        assert(this);
+        assert(block_size > 0);
+        if (ThreadCount == 0) {
+            ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+
+    ParallelDSVFileParser(const ParallelDSVFileParser &that) = delete;
+    ParallelDSVFileParser &operator=(const ParallelDSVFileParser &that) =
+      delete;
+
+    size_t GetThreadCount() const { assert(this); return ThreadCount; }
+    size_t GetMapThreshold() const { assert(this); return MapThreshold; }
+    size_t GetBlockSize() const { assert(this); return BlockSize; }
+
+    // Parse the files at the specified paths with handlers, an array of
+    // GetThreadCount() handlers, and then merge the handlers (see above).
+    // Files that can't be opened raise FileOpenException and files that
+    // can't be read raise IOException.  If a worker or a handler throws an
+    // exception, the workers are stopped after their current files and
+    // the first exception is rethrown, and the handlers aren't merged.
+    // The exceptions' sources point into paths.
+    template <typename Handler>
+    void Parse(const std::vector<std::string> &paths, Handler *handlers) {
+        assert(this);
+        assert(&paths);
+        assert(handlers);
+        Job<Handler> job(*this, paths, handlers);
+        std::vector<std::thread> workers;
+        auto worker_count = std::min(ThreadCount, paths.size());
+        try {
+            for (size_t index = 0; index < worker_count; ++index) {
+                workers.emplace_back([&job, index]() { job.Work(index); });
+            }
+        } catch (...) {
+            job.Stop();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            throw;
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        job.Finish();
+    }
+
+private:
+    template <typename Handler>
+    class Job {
+
+    public:
+        Job(const ParallelDSVFileParser &parser,
+          const std::vector<std::string> &paths, Handler *handlers)
+          : Parser(parser), Paths(paths), Handlers(handlers),
+            Queues(parser.ThreadCount) {
+            Deal();
+        }
+
+        void Work(size_t worker) {
+            size_t file;
+            while (Take(worker, &file)) {
+                try {
+                    ParseFile(Handlers[worker], Paths[file].c_str());
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(ErrorMutex);
+                    if (!Error) {
+                        Error = std::current_exception();
+                    }
+                    Stop();
+                    return;
+                }
+            }
+        }
+
+        // Discard the files that haven't been started.
+        void Stop() {
+            for (auto &queue : Queues) {
+                std::lock_guard<std::mutex> lock(queue.Mutex);
+                queue.Files.clear();
+            }
+        }
+
+        // Rethrow the first worker's exception or merge the handlers.
+        void Finish() {
+            if (Error) {
+                std::rethrow_exception(Error);
+            }
+            for (size_t index = 1; index < Parser.ThreadCount; ++index) {
+                Merge(Handlers[index],
+                  decltype(TestMerge<Handler>(0))());
+            }
+        }
+
+    private:
+        template <typename H>
+        static auto TestOnFileStart(int) -> decltype(
+          std::declval<H &>().OnFileStart(std::declval<const char *>()),
+          std::true_type());
+        template <typename H>
+        static std::false_type TestOnFileStart(...);
+
+        template <typename H>
+        static auto TestOnFileEnd(int) -> decltype(
+          std::declval<H &>().OnFileEnd(std::declval<const char *>()),
+          std::true_type());
+        template <typename H>
+        static std::false_type TestOnFileEnd(...);
+
+        template <typename H>
+        static auto TestMerge(int) -> decltype(
+          std::declval<H &>().Merge(std::declval<H &>()), std::true_type());
+        template <typename H>
+        static std::false_type TestMerge(...);
+
+        // This is one worker's files, largest first.  The worker takes
+        // files from the front, and so do thieves, so the largest files
+        // left are always started first.
+        struct Queue {
+            std::deque<size_t> Files;
+            std::mutex Mutex;
+        };
+
+        // Sort the files by size and deal them to the queues round-robin.
+        // Files that can't be examined are dealt as empty files: Opening
+        // them reports the error.
+        void Deal() {
+            Sizes.resize(Paths.size());
+            std::vector<size_t> order(Paths.size());
+            for (size_t index = 0; index < Paths.size(); ++index) {
+                struct stat info;
+                Sizes[index] = stat(Paths[index].c_str(), &info) == 0 &&
+                  S_ISREG(info.st_mode) ? static_cast<size_t>(info.st_size) :
+                  0;
+                order[index] = index;
+            }
+            std::stable_sort(order.begin(), order.end(),
+              [this](size_t a, size_t b) { return Sizes[a] > Sizes[b]; });
+            for (size_t index = 0; index < order.size(); ++index) {
+                Queues[index % Queues.size()].Files.push_back(order[index]);
+            }
+        }
+
+        // Take the worker's next file, stealing one from another worker if
+        // the worker has none.  Return false if no files are left.
+        bool Take(size_t worker, size_t *file) {
+            for (size_t offset = 0; offset < Queues.size(); ++offset) {
+                auto &queue = Queues[(worker + offset) % Queues.size()];
+                std::lock_guard<std::mutex> lock(queue.Mutex);
+                if (!queue.Files.empty()) {
+                    *file = queue.Files.front();
+                    queue.Files.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void ParseFile(Handler &handler, const char *path) {
+            handler.Reset();
+            OnFileStart(handler, path,
+              decltype(TestOnFileStart<Handler>(0))());
+            auto fd = open(path, O_RDONLY);
+            if (fd == -1) {
+                throw FileOpenException(path, errno);
+            }
+            try {
+                struct stat info;
+                if (fstat(fd, &info) == -1) {
+                    throw FileOpenException(path, errno);
+                }
+                if (S_ISREG(info.st_mode)) {
+                    auto size = static_cast<size_t>(info.st_size);
+                    if (size != 0 && size >= Parser.MapThreshold) {
+                        MappedFileReader reader(fd);
+                        handler.Parse(reader);
+                    } else {
+                        ParseDescriptor(handler, path, fd,
+                          std::min(Parser.BlockSize, size + 1));
+                    }
+                } else {
+                    ParseDescriptor(handler, path, fd, Parser.BlockSize);
+                }
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+            handler.FinishParsing();
+            OnFileEnd(handler, path, decltype(TestOnFileEnd<Handler>(0))());
+        }
+
+        void ParseDescriptor(Handler &handler, const char *path, int fd,
+          size_t block_size) {
+            DescriptorReader reader(fd, block_size,
+              DescriptorReader::Sequential);
+            handler.Parse(reader);
+            if (reader.Error()) {
+                throw IOException(path, reader.GetErrno());
+            }
+        }
+
+        void OnFileStart(Handler &handler, const char *path,
+          std::true_type) {
+            handler.OnFileStart(path);
+        }
+
+        void OnFileStart(Handler &, const char *, std::false_type) {}
+
+        void OnFileEnd(Handler &handler, const char *path, std::true_type) {
+            handler.OnFileEnd(path);
+        }
+
+        void OnFileEnd(Handler &, const char *, std::false_type) {}
+
+        void Merge(Handler &handler, std::true_type) {
+            Handlers[0].Merge(handler);
+        }
+
+        void Merge(Handler &, std::false_type) {}
+
+        const ParallelDSVFileParser &Parser;
+        const std::vector<std::string> &Paths;
+        Handler *Handlers;
+        std::vector<size_t> Sizes;
+        std::vector<Queue> Queues;
+        std::exception_ptr Error;
+        std::mutex ErrorMutex;
+
+    };  // class Job
+
+    size_t ThreadCount;
+    size_t MapThreshold;
+    size_t BlockSize;
+
+};  // class ParallelDSVFileParser
+
+}   // namespace libpt
@@ -0,0 +1,287 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class that reads from another reader on a
+// background thread, so that reading (including waiting for slow storage
+// and decompressing) overlaps with parsing.  libpt parsers can use it in
+// templated parsing functions.  Programs using it must be linked with the
+// platform's thread library (e.g., -pthread).
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Exceptions.h>
+
+namespace libpt {
+
+// Instances of this class read blocks from a Source reader, which must
+// implement ReadBlock and Error (see DSVParser::Parse), on a background
+// thread and pass them to the consuming thread through a bounded ring of
+// buffers.  Any reader works as a source, including FileReaders,
+// MappedFileReaders, and DecompressingReaders; the source's blocks are
+// copied into the ring's buffers (in pieces, if they're larger), since
+// sources' blocks are only valid until their next reads.  The buffers are
+// allocated once and recycled, so the pipeline doesn't allocate once it
+// has started.
+//
+// The ring is a single-producer, single-consumer queue: The threads
+// exchange buffers by updating atomic indices, without locks.  A thread
+// only locks a mutex to sleep when the ring is empty (for the consumer) or
+// full (for the background thread) and to wake the other thread up.
+//
+// The readers implement ReadChar, TryReadChar, ReadBlock, IsEOF, and
+// Error.  Blocks remain valid until the next call that needs a new block.
+// If the source throws an exception, the reader rethrows it from the
+// consumer's next read after the blocks read before it.  The readers don't
+// own their sources, and the source mustn't be used by others until the
+// reader is destroyed.  Destroying a reader waits for the source's read in
+// progress, if any.
+template <typename Source>
+class PipelinedReader {
+
+public:
+    static const size_t DefaultBlockSize = 256 * 1024;
+    static const size_t DefaultBufferCount = 8;
+
+    PipelinedReader() = delete;
+
+    // Start reading source in the background into buffer_count buffers of
+    // block_size bytes each.
+    PipelinedReader(Source *source, size_t block_size = DefaultBlockSize,
+      size_t buffer_count = DefaultBufferCount)
+      : Input(source), BlockSize(block_size), Buffers(buffer_count),
+        Sizes(buffer_count, 0), Head(0), Tail(0), Finished(false),
+        Stopping(false), ConsumerWaiting(false), ProducerWaiting(false),
+        SourceError(false), Holding(false), Current(nullptr), End(nullptr),
+        AtEnd(false) {
+        assert(this);
+        assert(source);
+        assert(block_size > 0);
+        assert(buffer_count > 0);
+        for (auto &buffer : Buffers) {
+            buffer.reset(new char[block_size]);
+        }
+        Worker = std::thread([this]() { Work(); });
+    }
+
+    PipelinedReader(const PipelinedReader &that) = delete;
+    PipelinedReader &operator=(const PipelinedReader &that) = delete;
+
+    ~PipelinedReader() {
+        assert(this);
+        Stopping.store(true);
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+        }
+        NotFull.notify_one();
+        Worker.join();
+    }
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !FetchBlock()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !FetchBlock()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !FetchBlock()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return AtEnd && Current == End; }
+
+    // Return true if the source failed.  This is only known at the end of
+    // the stream.
+    inline bool Error() { assert(this); return AtEnd && SourceError; }
+
+    Source *GetSource() const { assert(this); return Input; }
+
+private:
+    // Give the held buffer back to the background thread and point Current
+    // and End at the next filled buffer.  Return false at the end of the
+    // stream.
+    bool FetchBlock() {
+        assert(this);
+        if (AtEnd) {
+            return false;
+        }
+        auto head = Head.load(std::memory_order_relaxed);
+        if (Holding) {
+            Holding = false;
+            Head.store(++head);
+            if (ProducerWaiting.load()) {
+                {
+                    std::lock_guard<std::mutex> lock(Mutex);
+                }
+                NotFull.notify_one();
+            }
+        }
+        if (Tail.load(std::memory_order_acquire) == head) {
+            std::unique_lock<std::mutex> lock(Mutex);
+            ConsumerWaiting.store(true);
+            NotEmpty.wait(lock, [this, head]() {
+                return Tail.load() != head || Finished.load();
+            });
+            ConsumerWaiting.store(false);
+        }
+
+        // Finished is set after the last buffer is published, so check the
+        // ring again.
+        if (Tail.load(std::memory_order_acquire) == head) {
+            AtEnd = true;
+            Current = End = nullptr;
+            if (Failure) {
+                std::rethrow_exception(Failure);
+            }
+            return false;
+        }
+        auto index = head % Buffers.size();
+        Holding = true;
+        Current = Buffers[index].get();
+        End = Current + Sizes[index];
+        return true;
+    }
+
+    // This is the background thread's loop.  It reads the source until the
+    // end of the stream, an exception, or the reader's destruction.
+    void Work() {
+        assert(this);
+        try {
+            const char *block;
+            size_t size;
+            while ((size = Input->ReadBlock(&block)) != 0) {
+                while (size != 0) {
+                    auto tail = Tail.load(std::memory_order_relaxed);
+                    if (!WaitForBuffer(tail)) {
+                        return;
+                    }
+                    auto index = tail % Buffers.size();
+                    auto piece = std::min(size, BlockSize);
+                    memcpy(Buffers[index].get(), block, piece);
+                    Sizes[index] = piece;
+                    Publish(tail + 1);
+                    block += piece;
+                    size -= piece;
+                }
+            }
+            SourceError = Input->Error();
+        } catch (...) {
+            Failure = std::current_exception();
+        }
+        Finished.store(true);
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+        }
+        NotEmpty.notify_one();
+    }
+
+    // Wait until the buffer at the tail is free.  Return false if the
+    // reader is being destroyed.
+    bool WaitForBuffer(size_t tail) {
+        assert(this);
+        if (tail - Head.load(std::memory_order_acquire) == Buffers.size()) {
+            std::unique_lock<std::mutex> lock(Mutex);
+            ProducerWaiting.store(true);
+            NotFull.wait(lock, [this, tail]() {
+                return tail - Head.load() != Buffers.size() || Stopping.load();
+            });
+            ProducerWaiting.store(false);
+        }
+        return !Stopping.load(std::memory_order_relaxed);
+    }
+
+    // Hand the buffers before tail to the consumer.
+    void Publish(size_t tail) {
+        assert(this);
+
+        // The sequentially consistent store and load here and in
+        // FetchBlock ensure that the consumer either sees the new tail
+        // before sleeping or sets ConsumerWaiting in time for this to see
+        // it.  Locking the mutex before notifying ensures that the
+        // consumer is then actually waiting.
+        Tail.store(tail);
+        if (ConsumerWaiting.load()) {
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+            }
+            NotEmpty.notify_one();
+        }
+    }
+
+    Source *Input;
+    size_t BlockSize;
+    std::vector<std::unique_ptr<char[]>> Buffers;
+    std::vector<size_t> Sizes;
+
+    // Buffers [Head, Tail) (modulo the number of buffers) are filled.  Only
+    // the consumer advances Head and only the background thread advances
+    // Tail.  They're on separate cache lines so that the threads don't
+    // contend for one.
+    alignas(64) std::atomic<size_t> Head;
+    alignas(64) std::atomic<size_t> Tail;
+
+    alignas(64) std::atomic<bool> Finished;
+    std::atomic<bool> Stopping;
+    std::atomic<bool> ConsumerWaiting;
+    std::atomic<bool> ProducerWaiting;
+
+    // These are set by the background thread before it sets Finished.
+    bool SourceError;
+    std::exception_ptr Failure;
+
+    // These are only used for sleeping and waking up.
+    std::mutex Mutex;
+    std::condition_variable NotEmpty;
+    std::condition_variable NotFull;
+
+    // true if the consumer is reading the buffer at Head
+    bool Holding;
+
+    // the unread part of the held buffer
+    const char *Current;
+    const char *End;
+
+    bool AtEnd;
+    std::thread Worker;
+
+};  // class PipelinedReader
+
+}   // namespace libpt
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <cstring>
+#include <utility>
 #include <Exceptions.h>
 
 namespace libpt {
@@ -34,6 +36,11 @@ namespace libpt {
 //     * end, a method returning a const_iterator representing the end of
 //       the String
 //
+// If String also has a data method returning a pointer to its contiguous
+// characters (as std::basic_string and std::vector do), StringReader
+// provides ReadBlock, which returns all of the remaining characters as
+// a single block.
+//
 // The lengths of Strings shouldn't be modified while StringReaders are
 // using them.
 template <typename String>
@@ -56,6 +63,30 @@ public:
         return *Current++;
     }
 
+    // This is like ReadChar except that it stores the character in *c
+    // and returns false instead of throwing EOFException at the end of
+    // the string.
+    inline bool TryReadChar(typename String::value_type *c) {
+        assert(this);
+        assert(c);
+        if (Current == End) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    template <typename S = String>
+    inline auto ReadBlock(const typename String::value_type **block)
+      -> decltype(std::declval<const S &>().data(), size_t()) {
+        assert(this);
+        assert(block);
+        auto size = static_cast<size_t>(End - Current);
+        *block = BackingString.data() + (Current - BackingString.begin());
+        Current = End;
+        return size;
+    }
+
     inline bool IsEOF() { assert(this); return Current == End; }
     inline bool Error() { assert(this); return false; }
 
@@ -93,6 +124,25 @@ public:
         return *Current++;
     }
 
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (*Current == '\0') {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        auto size = strlen(Current);
+        *block = Current;
+        Current += size;
+        return size;
+    }
+
     inline bool IsEOF() { assert(this); return *Current == '\0'; }
     inline bool Error() { assert(this); return false; }
 
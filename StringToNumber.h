@@ -12,11 +12,53 @@
 // This is a collection of functions for converting strings to numbers.
 // The standard C and C++11 libraries provide functions to do this, but
 // none of them are templated.  This header solves that problem.
+//
+// It also provides conversions from ranges of characters that needn't be
+// null-terminated, such as fields in the middle of a DSV file's buffer.
+// Those don't use the C strto* functions for integers, and they use
+// std::from_chars for floating point numbers if it's available.
+//
+// Finally, StringsToNumbers converts whole columns of fields at once.
+// Decimal integers with at most 16 digits are validated and accumulated
+// eight or sixteen digits at a time, using SSE4.1 if the compiler targets
+// it (as indicated by __SSE4_1__) and 64-bit SWAR arithmetic otherwise.
 
 #pragma once
 
+#include <cassert>
+#include <cerrno>
 #include <cinttypes>
+#include <cstdlib>
+#include <algorithm>
 #include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+// strtod_l and friends convert in a given locale rather than the current
+// one.  glibc declares them if _GNU_SOURCE is defined (as g++ does by
+// default), and the BSDs and macOS declare them in <xlocale.h>.
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+#include <locale.h>
+#define LIBPT_STRTOD_L 1
+#elif defined(__has_include)
+#if __has_include(<xlocale.h>)
+#include <locale.h>
+#include <xlocale.h>
+#define LIBPT_STRTOD_L 1
+#endif
+#endif
 
 namespace libpt {
 
@@ -29,9 +71,20 @@ template<typename T> T StringToNumber(const char *str,
     return StringToNumber<unsigned long long>(str, end_idx, base);
 }
 
+// These are StringToNumber for null-terminated wide strings (and, through
+// the String form, std::wstring, std::u16string, and std::u32string).
+// They skip leading whitespace, as the C strto* functions do, and then
+// convert like the range form (see below).
+template<typename T> T StringToNumber(const wchar_t *str,
+  size_t *end_idx = nullptr, int base = 10);
+template<typename T> T StringToNumber(const char16_t *str,
+  size_t *end_idx = nullptr, int base = 10);
+template<typename T> T StringToNumber(const char32_t *str,
+  size_t *end_idx = nullptr, int base = 10);
+
 // This is a templated form for C++ string classes that provide a
 // c_str method returning a null-terminated C string.  This uses
-// the C strto* functions.
+// the C strto* functions for char strings.
 template<typename T, typename String> T StringToNumber(const String &str,
   size_t *end_idx = nullptr, int base = 10) {
     return StringToNumber<T>(str.c_str(), end_idx, base);
@@ -40,8 +93,8 @@ template<typename T, typename String> T StringToNumber(const String &str,
 
 // Specializations for the C string versions
 
-template<> long double StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline long double StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     char *end;
     auto val = strtold(str, &end);
     if (end_idx) {
@@ -50,7 +103,8 @@ template<> long double StringToNumber(const char *str, size_t *end_idx,
     return val;
 }
 
-template<> double StringToNumber(const char *str, size_t *end_idx, int base) {
+template<> inline double StringToNumber(const char *str, size_t *end_idx,
+  int base) {
     char *end;
     auto val = strtod(str, &end);
     if (end_idx) {
@@ -59,7 +113,8 @@ template<> double StringToNumber(const char *str, size_t *end_idx, int base) {
     return val;
 }
 
-template<> float StringToNumber(const char *str, size_t *end_idx, int base) {
+template<> inline float StringToNumber(const char *str, size_t *end_idx,
+  int base) {
     char *end;
     auto val = strtof(str, &end);
     if (end_idx) {
@@ -68,8 +123,8 @@ template<> float StringToNumber(const char *str, size_t *end_idx, int base) {
     return val;
 }
 
-template<> long long StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline long long StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     char *end;
     auto val = strtoll(str, &end, base);
     if (end_idx) {
@@ -78,8 +133,8 @@ template<> long long StringToNumber(const char *str, size_t *end_idx,
     return val;
 }
 
-template<> unsigned long long StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline unsigned long long StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     char *end;
     auto val = strtoull(str, &end, base);
     if (end_idx) {
@@ -88,7 +143,8 @@ template<> unsigned long long StringToNumber(const char *str, size_t *end_idx,
     return val;
 }
 
-template<> long StringToNumber(const char *str, size_t *end_idx, int base) {
+template<> inline long StringToNumber(const char *str, size_t *end_idx,
+  int base) {
     char *end;
     auto val = strtol(str, &end, base);
     if (end_idx) {
@@ -97,8 +153,8 @@ template<> long StringToNumber(const char *str, size_t *end_idx, int base) {
     return val;
 }
 
-template<> unsigned long StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline unsigned long StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     char *end;
     auto val = strtoul(str, &end, base);
     if (end_idx) {
@@ -107,22 +163,619 @@ template<> unsigned long StringToNumber(const char *str, size_t *end_idx,
     return val;
 }
 
-template<> int StringToNumber(const char *str, size_t *end_idx, int base) {
+template<> inline int StringToNumber(const char *str, size_t *end_idx,
+  int base) {
     return StringToNumber<long>(str, end_idx, base);
 }
 
-template<> unsigned int StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline unsigned int StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     return StringToNumber<unsigned long>(str, end_idx, base);
 }
 
-template<> short StringToNumber(const char *str, size_t *end_idx, int base) {
+template<> inline short StringToNumber(const char *str, size_t *end_idx,
+  int base) {
     return StringToNumber<long>(str, end_idx, base);
 }
 
-template<> unsigned short StringToNumber(const char *str, size_t *end_idx,
-  int base) {
+template<> inline unsigned short StringToNumber(const char *str,
+  size_t *end_idx, int base) {
     return StringToNumber<unsigned long>(str, end_idx, base);
 }
 
+// This is a templated, locale-independent conversion for the characters
+// in [begin, end), which needn't be null-terminated.  It works for all
+// integral and floating point types.  If stop isn't null, *stop is set to
+// the first character that isn't part of the number (or begin if no
+// number could be parsed, in which case zero is returned).
+//
+// Integers are parsed like strtol and friends except that leading
+// whitespace isn't skipped and unsigned types don't accept a minus sign.
+// base may be 0 or 2 to 36, as for strtol.  If the number is out of range,
+// errno is set to ERANGE and the closest representable value is returned.
+//
+// Floating point numbers are parsed like strtod (in the C locale) except
+// that leading whitespace isn't skipped and base is ignored.  If the
+// standard library provides std::from_chars for floating point numbers,
+// it's used; otherwise, numbers with at most 15 significant digits and
+// small exponents are computed exactly without strtod and others are
+// copied into a temporary buffer for strtod_l in the C locale.  (The few
+// platforms without strtod_l use strtod, which follows LC_NUMERIC.)
+template<typename T> T StringToNumber(const char *begin, const char *end,
+  const char **stop, int base = 10);
+
+namespace detail {
+
+inline int DigitValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 10;
+    }
+    return 36;
+}
+
+template<typename T> T RangeToInteger(const char *begin, const char *end,
+  const char **stop, int base) {
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    auto c = begin;
+    auto negative = false;
+    if (c != end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        if (negative && !std::is_signed<T>::value) {
+            if (stop) {
+                *stop = begin;
+            }
+            return 0;
+        }
+        ++c;
+    }
+    if (base == 0 || base == 16) {
+        if (end - c >= 3 && c[0] == '0' && (c[1] == 'x' || c[1] == 'X') &&
+          DigitValue(c[2]) < 16) {
+            c += 2;
+            base = 16;
+        } else if (base == 0) {
+            base = (c != end && *c == '0') ? 8 : 10;
+        }
+    }
+    assert(base >= 2 && base <= 36);
+    Unsigned limit = std::numeric_limits<T>::max();
+    if (negative) {
+        limit += 1;
+    }
+    const Unsigned cutoff = limit / base;
+    const int cutoff_digit = static_cast<int>(limit % base);
+    Unsigned value = 0;
+    auto overflow = false;
+    auto digits = c;
+    for (; c != end; ++c) {
+        auto digit = DigitValue(*c);
+        if (digit >= base) {
+            break;
+        }
+        if (value > cutoff || (value == cutoff && digit > cutoff_digit)) {
+            overflow = true;
+        } else {
+            value = value * base + digit;
+        }
+    }
+    if (c == digits) {
+        if (stop) {
+            *stop = begin;
+        }
+        return 0;
+    }
+    if (stop) {
+        *stop = c;
+    }
+    if (overflow) {
+        errno = ERANGE;
+        return negative ? std::numeric_limits<T>::min()
+          : std::numeric_limits<T>::max();
+    }
+    return negative ? static_cast<T>(0 - value) : static_cast<T>(value);
+}
+
+// This parses decimal floating point numbers with at most MaxDigits
+// significant digits and exponents whose magnitudes are at most
+// MaxExponent.  Both the significand and the power of ten are exactly
+// representable, so multiplying or dividing them once rounds correctly.
+// It returns false if the number isn't in that form.
+template<typename T, int MaxDigits, int MaxExponent>
+bool FastRangeToFloat(const char *begin, const char *end, T *value,
+  const char **stop) {
+    static const T Powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    auto c = begin;
+    auto negative = false;
+    if (c != end && (*c == '-' || *c == '+')) {
+        negative = *c++ == '-';
+    }
+    uint64_t significand = 0;
+    int digits = 0;
+    int exponent = 0;
+    auto mantissa = c;
+    for (; c != end && *c >= '0' && *c <= '9'; ++c) {
+        if (significand || *c != '0') {
+            significand = significand * 10 + (*c - '0');
+            if (++digits > MaxDigits) {
+                return false;
+            }
+        }
+    }
+    if (c != end && *c == '.') {
+        for (++c; c != end && *c >= '0' && *c <= '9'; ++c) {
+            if (significand || *c != '0') {
+                significand = significand * 10 + (*c - '0');
+                if (++digits > MaxDigits) {
+                    return false;
+                }
+            }
+            --exponent;
+        }
+    }
+    if (c == mantissa || (c == mantissa + 1 && *mantissa == '.')) {
+        return false;
+    }
+    if (c != end && (*c == 'e' || *c == 'E')) {
+        auto e = c + 1;
+        auto negative_exponent = false;
+        if (e != end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e++ == '-';
+        }
+        if (e != end && *e >= '0' && *e <= '9') {
+            int explicit_exponent = 0;
+            for (; e != end && *e >= '0' && *e <= '9'; ++e) {
+                if (explicit_exponent > MaxExponent * 2) {
+                    return false;
+                }
+                explicit_exponent = explicit_exponent * 10 + (*e - '0');
+            }
+            exponent += negative_exponent ? -explicit_exponent
+              : explicit_exponent;
+            c = e;
+        }
+    }
+    if (c != end && (*c == 'x' || *c == 'X' || *c == 'n' || *c == 'N' ||
+      *c == 'i' || *c == 'I')) {
+        return false;
+    }
+    if (exponent < -MaxExponent || exponent > MaxExponent) {
+        return false;
+    }
+    T result = static_cast<T>(significand);
+    result = exponent < 0 ? result / Powers[-exponent]
+      : result * Powers[exponent];
+    *value = negative ? -result : result;
+    if (stop) {
+        *stop = c;
+    }
+    return true;
+}
+
+#if defined(LIBPT_STRTOD_L)
+
+// Return a locale whose LC_NUMERIC category is the C locale's, or null if
+// it can't be created.  It's created once and never freed.
+inline locale_t NumericCLocale() {
+    static const locale_t locale = newlocale(LC_NUMERIC_MASK, "C",
+      static_cast<locale_t>(0));
+    return locale;
+}
+
+#endif
+
+// These are strtof, strtod, and strtold in the C locale.
+template<typename T> T CLocaleStringToFloat(const char *str, char **end);
+
+template<> inline float CLocaleStringToFloat(const char *str, char **end) {
+#if defined(LIBPT_STRTOD_L)
+    if (auto locale = NumericCLocale()) {
+        return strtof_l(str, end, locale);
+    }
+#endif
+    return strtof(str, end);
+}
+
+template<> inline double CLocaleStringToFloat(const char *str, char **end) {
+#if defined(LIBPT_STRTOD_L)
+    if (auto locale = NumericCLocale()) {
+        return strtod_l(str, end, locale);
+    }
+#endif
+    return strtod(str, end);
+}
+
+template<> inline long double CLocaleStringToFloat(const char *str,
+  char **end) {
+#if defined(LIBPT_STRTOD_L)
+    if (auto locale = NumericCLocale()) {
+        return strtold_l(str, end, locale);
+    }
+#endif
+    return strtold(str, end);
+}
+
+template<typename T> T SlowRangeToFloat(const char *begin, const char *end,
+  const char **stop) {
+    // strto* needs a null-terminated copy.  Long ranges (e.g., numbers
+    // with hundreds of digits) are copied to the heap whole rather than
+    // truncated.
+    char short_buffer[128];
+    std::string long_buffer;
+    auto size = static_cast<size_t>(end - begin);
+    auto buffer = short_buffer;
+    if (size >= sizeof(short_buffer)) {
+        long_buffer.resize(size + 1);
+        buffer = &long_buffer[0];
+    }
+    memcpy(buffer, begin, size);
+    buffer[size] = '\0';
+
+    // strto* would skip leading whitespace.
+    if (size == 0 || (buffer[0] != '+' && buffer[0] != '-' &&
+      buffer[0] != '.' && (buffer[0] < '0' || buffer[0] > '9') &&
+      buffer[0] != 'i' && buffer[0] != 'I' && buffer[0] != 'n' &&
+      buffer[0] != 'N')) {
+        if (stop) {
+            *stop = begin;
+        }
+        return 0;
+    }
+    char *number_end;
+    auto value = CLocaleStringToFloat<T>(buffer, &number_end);
+    if (stop) {
+        *stop = begin + (number_end - buffer);
+    }
+    return value;
+}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+
+template<typename T> T RangeToFloat(const char *begin, const char *end,
+  const char **stop) {
+    auto c = begin;
+    if (c != end && *c == '+' && c + 1 != end && *(c + 1) != '-') {
+        ++c;
+    }
+    auto digits = (c != end && *c == '-') ? c + 1 : c;
+    if (end - digits >= 2 && digits[0] == '0' &&
+      (digits[1] == 'x' || digits[1] == 'X')) {
+        // from_chars doesn't parse hexadecimal prefixes.
+        return SlowRangeToFloat<T>(begin, end, stop);
+    }
+    T value = 0;
+    auto result = std::from_chars(c, end, value);
+    if (result.ec == std::errc::invalid_argument) {
+        if (stop) {
+            *stop = begin;
+        }
+        return 0;
+    }
+    if (result.ec == std::errc::result_out_of_range) {
+        // from_chars leaves the value alone, but strtod saturates (or
+        // underflows) and sets errno, so let it handle this rare case.
+        value = SlowRangeToFloat<T>(begin, result.ptr, nullptr);
+    }
+    if (stop) {
+        *stop = result.ptr;
+    }
+    return value;
+}
+
+#else
+
+template<typename T> T RangeToFloat(const char *begin, const char *end,
+  const char **stop) {
+    T value;
+    auto fast = sizeof(T) == sizeof(float)
+      ? FastRangeToFloat<T, 7, 10>(begin, end, &value, stop)
+      : FastRangeToFloat<T, 15, 22>(begin, end, &value, stop);
+    return fast ? value : SlowRangeToFloat<T>(begin, end, stop);
+}
+
+#endif
+
+template<typename T> T RangeToNumber(const char *begin, const char *end,
+  const char **stop, int, std::true_type) {
+    return RangeToFloat<T>(begin, end, stop);
+}
+
+template<typename T> T RangeToNumber(const char *begin, const char *end,
+  const char **stop, int base, std::false_type) {
+    return RangeToInteger<T>(begin, end, stop, base);
+}
+
+}   // namespace detail
+
+template<typename T> T StringToNumber(const char *begin, const char *end,
+  const char **stop, int base) {
+    static_assert(std::is_arithmetic<T>::value &&
+      !std::is_same<T, bool>::value,
+      "StringToNumber requires an arithmetic type other than bool");
+    assert(begin <= end);
+    return detail::RangeToNumber<T>(begin, end, stop, base,
+      std::is_floating_point<T>());
+}
+
+// These are the range form of StringToNumber for wide characters.  Numbers
+// are ASCII, so the characters up to the first non-ASCII character are
+// narrowed into a buffer that the char form converts.
+template<typename T> T StringToNumber(const wchar_t *begin,
+  const wchar_t *end, const wchar_t **stop, int base = 10);
+template<typename T> T StringToNumber(const char16_t *begin,
+  const char16_t *end, const char16_t **stop, int base = 10);
+template<typename T> T StringToNumber(const char32_t *begin,
+  const char32_t *end, const char32_t **stop, int base = 10);
+
+namespace detail {
+
+template<typename CharT> bool IsASCII(CharT c) {
+    typedef typename std::make_unsigned<CharT>::type Unsigned;
+    return static_cast<Unsigned>(c) < 0x80;
+}
+
+template<typename T, typename CharT> T WideRangeToNumber(const CharT *begin,
+  const CharT *end, const CharT **stop, int base) {
+    assert(begin <= end);
+    auto ascii_end = begin;
+    while (ascii_end != end && IsASCII(*ascii_end)) {
+        ++ascii_end;
+    }
+    auto size = static_cast<size_t>(ascii_end - begin);
+    char buffer[128];
+    std::string long_buffer;
+    auto narrow = buffer;
+    if (size > sizeof(buffer)) {
+        long_buffer.resize(size);
+        narrow = &long_buffer[0];
+    }
+    std::transform(begin, ascii_end, narrow,
+      [](CharT c) { return static_cast<char>(c); });
+    const char *narrow_stop;
+    auto value = StringToNumber<T>(narrow, narrow + size, &narrow_stop,
+      base);
+    if (stop) {
+        *stop = begin + (narrow_stop - narrow);
+    }
+    return value;
+}
+
+template<typename T, typename CharT> T WideStringToNumber(const CharT *str,
+  size_t *end_idx, int base) {
+    assert(str);
+    auto begin = str;
+    while (*begin == ' ' || (*begin >= '\t' && *begin <= '\r')) {
+        ++begin;
+    }
+    auto end = begin + std::char_traits<CharT>::length(begin);
+    const CharT *stop;
+    auto value = WideRangeToNumber<T>(begin, end, &stop, base);
+    if (end_idx) {
+        *end_idx = stop == begin ? 0 : static_cast<size_t>(stop - str);
+    }
+    return value;
+}
+
+}   // namespace detail
+
+template<typename T> T StringToNumber(const wchar_t *begin,
+  const wchar_t *end, const wchar_t **stop, int base) {
+    return detail::WideRangeToNumber<T>(begin, end, stop, base);
+}
+
+template<typename T> T StringToNumber(const char16_t *begin,
+  const char16_t *end, const char16_t **stop, int base) {
+    return detail::WideRangeToNumber<T>(begin, end, stop, base);
+}
+
+template<typename T> T StringToNumber(const char32_t *begin,
+  const char32_t *end, const char32_t **stop, int base) {
+    return detail::WideRangeToNumber<T>(begin, end, stop, base);
+}
+
+template<typename T> T StringToNumber(const wchar_t *str, size_t *end_idx,
+  int base) {
+    return detail::WideStringToNumber<T>(str, end_idx, base);
+}
+
+template<typename T> T StringToNumber(const char16_t *str, size_t *end_idx,
+  int base) {
+    return detail::WideStringToNumber<T>(str, end_idx, base);
+}
+
+template<typename T> T StringToNumber(const char32_t *str, size_t *end_idx,
+  int base) {
+    return detail::WideStringToNumber<T>(str, end_idx, base);
+}
+
+// These convert count fields to Ts at once.  The first form takes the
+// fields' characters in a single buffer, bytes, with field i occupying
+// [bytes + offsets[i], bytes + offsets[i + 1]), so offsets has count + 1
+// elements.  The second takes an array of Spans, which must have public
+// Data (a const char pointer) and Size members, like DSVField.
+//
+// Each field is converted as by the range form of StringToNumber (in base
+// 10 for integers) and the result is stored in values.  A field is
+// erroneous if it isn't entirely a number or if it's out of range.  If
+// errors isn't null, it must point to (count + 63) / 64 words: Bit i % 64
+// of word i / 64 is set if and only if field i is erroneous.  These return
+// the number of erroneous fields.  errno isn't modified.
+template<typename T> size_t StringsToNumbers(const char *bytes,
+  const size_t *offsets, size_t count, T *values, uint64_t *errors);
+
+template<typename T, typename Span> size_t StringsToNumbers(
+  const Span *spans, size_t count, T *values, uint64_t *errors);
+
+namespace detail {
+
+// Convert size (1 to 16) digits to an integer.  Return false if any of
+// the characters isn't a digit.
+inline bool ParseShortDigits(const char *digits, size_t size,
+  uint64_t *value) {
+    assert(size > 0 && size <= 16);
+
+    // Right-align the digits in a buffer of zeros so that every number
+    // has 16 digits.
+    char buffer[16];
+    memset(buffer, '0', sizeof(buffer));
+    memcpy(buffer + sizeof(buffer) - size, digits, size);
+#if defined(__SSE4_1__)
+    auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer));
+    auto nines = _mm_set1_epi8(9);
+    auto values = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, nines),
+      nines)) != 0xFFFF) {
+        return false;
+    }
+    auto pairs = _mm_maddubs_epi16(values,
+      _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    auto quads = _mm_madd_epi16(pairs,
+      _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    auto octets = _mm_madd_epi16(_mm_packus_epi32(quads, quads),
+      _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+    auto high = static_cast<uint32_t>(_mm_cvtsi128_si32(octets));
+    auto low = static_cast<uint32_t>(_mm_extract_epi32(octets, 1));
+    *value = high * UINT64_C(100000000) + low;
+    return true;
+#else
+    uint64_t result = 0;
+    for (size_t offset = 0; offset < sizeof(buffer); offset += 8) {
+        uint64_t chunk;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(&chunk, buffer + offset, 8);
+#else
+        chunk = 0;
+        for (int index = 7; index >= 0; --index) {
+            chunk = (chunk << 8) | static_cast<unsigned char>(
+              buffer[offset + index]);
+        }
+#endif
+        // Every byte must be in 0x30 to 0x39.
+        if ((chunk & UINT64_C(0xF0F0F0F0F0F0F0F0)) !=
+          UINT64_C(0x3030303030303030) ||
+          ((chunk + UINT64_C(0x0606060606060606)) &
+          UINT64_C(0xF0F0F0F0F0F0F0F0)) != UINT64_C(0x3030303030303030)) {
+            return false;
+        }
+
+        // Combine adjacent digits, then pairs, then quads.  The first
+        // character is in the lowest byte.
+        chunk -= UINT64_C(0x3030303030303030);
+        chunk = (chunk * 10) + (chunk >> 8);
+        chunk = (((chunk & UINT64_C(0x000000FF000000FF)) *
+          (100 + (UINT64_C(1000000) << 32))) +
+          (((chunk >> 16) & UINT64_C(0x000000FF000000FF)) *
+          (1 + (UINT64_C(10000) << 32)))) >> 32;
+        result = result * UINT64_C(100000000) + static_cast<uint32_t>(chunk);
+    }
+    *value = result;
+    return true;
+#endif
+}
+
+template<typename T> bool FastFieldToInteger(const char *begin,
+  const char *end, T *value) {
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    auto negative = false;
+    if (begin != end && (*begin == '-' || *begin == '+')) {
+        negative = *begin++ == '-';
+        if (negative && !std::is_signed<T>::value) {
+            return false;
+        }
+    }
+    auto size = static_cast<size_t>(end - begin);
+    uint64_t magnitude;
+    if (size == 0 || size > 16 ||
+      !ParseShortDigits(begin, size, &magnitude)) {
+        return false;
+    }
+    uint64_t limit = static_cast<Unsigned>(std::numeric_limits<T>::max());
+    if (negative) {
+        limit += 1;
+    }
+    if (magnitude > limit) {
+        return false;
+    }
+    *value = negative ? static_cast<T>(0 - static_cast<Unsigned>(magnitude))
+      : static_cast<T>(magnitude);
+    return true;
+}
+
+template<typename T> bool FieldToNumber(const char *begin, const char *end,
+  T *value, std::false_type) {
+    if (FastFieldToInteger(begin, end, value)) {
+        return true;
+    }
+    const char *stop;
+    errno = 0;
+    *value = StringToNumber<T>(begin, end, &stop, 10);
+    return stop == end && begin != end && errno != ERANGE;
+}
+
+template<typename T> bool FieldToNumber(const char *begin, const char *end,
+  T *value, std::true_type) {
+    const char *stop;
+    errno = 0;
+    *value = StringToNumber<T>(begin, end, &stop);
+    return stop == end && begin != end && errno != ERANGE;
+}
+
+// This converts the fields with the specified index and stores the errors
+// in errors.  Fields(index) must return a field's bounds as a pair.
+template<typename T, typename Fields> size_t FieldsToNumbers(
+  const Fields &fields, size_t count, T *values, uint64_t *errors) {
+    static_assert(std::is_arithmetic<T>::value &&
+      !std::is_same<T, bool>::value,
+      "StringsToNumbers requires an arithmetic type other than bool");
+    assert(values || count == 0);
+    auto saved_errno = errno;
+    size_t error_count = 0;
+    for (size_t word = 0; word * 64 < count; ++word) {
+        uint64_t bits = 0;
+        auto last = std::min(count, word * 64 + 64);
+        for (auto index = word * 64; index < last; ++index) {
+            auto field = fields(index);
+            if (!FieldToNumber(field.first, field.second, values + index,
+              std::is_floating_point<T>())) {
+                bits |= UINT64_C(1) << (index % 64);
+                ++error_count;
+            }
+        }
+        if (errors) {
+            errors[word] = bits;
+        }
+    }
+    errno = saved_errno;
+    return error_count;
+}
+
+}   // namespace detail
+
+template<typename T> size_t StringsToNumbers(const char *bytes,
+  const size_t *offsets, size_t count, T *values, uint64_t *errors) {
+    assert(offsets);
+    assert(bytes || count == 0 || offsets[count] == offsets[0]);
+    return detail::FieldsToNumbers(
+      [bytes, offsets](size_t index) {
+        return std::make_pair(bytes + offsets[index],
+          bytes + offsets[index + 1]);
+      }, count, values, errors);
+}
+
+template<typename T, typename Span> size_t StringsToNumbers(
+  const Span *spans, size_t count, T *values, uint64_t *errors) {
+    assert(spans || count == 0);
+    return detail::FieldsToNumbers(
+      [spans](size_t index) {
+        const char *data = spans[index].Data;
+        return std::make_pair(data, data + spans[index].Size);
+      }, count, values, errors);
+}
+
 }   // namespace libpt
@@ -0,0 +1,279 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines a class for reading growing files, such as
+// append-only logs, a piece at a time as they grow.  libpt parsers can use
+// it in templated parsing functions.  It requires POSIX.  On Linux, it
+// waits for files to grow with inotify.
+
+#pragma once
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <DSVIndex.h>
+#include <Exceptions.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/inotify.h>)
+#define LIBPT_INOTIFY 1
+#include <sys/inotify.h>
+#endif
+#endif
+
+namespace libpt {
+
+// Instances of this class read the bytes that have been appended to a file
+// since they last read it.  ReadBlock returns zero (and IsEOF returns true)
+// when the reader has caught up with the file, but later calls return
+// whatever has been appended since then, so passing the same reader and
+// parser to DSVParser::Parse on every poll parses each byte once.  The
+// parser's state carries records that were incomplete at the end of one
+// poll over to the next.  Wait blocks until the file grows.
+//
+// The readers also track the offset of the last DSV record boundary in
+// what they've read (see GetRecordBoundary), so programs can save it and
+// resume from it (with a fresh parser) after restarting.
+//
+// The readers follow the file they opened, even if it's renamed.  If the
+// file shrinks, IsTruncated returns true and nothing more is read until
+// Restart is called.  Read errors end the stream; Error and GetErrno
+// report them.
+class TailingReader {
+
+public:
+    static const size_t DefaultBlockSize = 256 * 1024;
+
+    TailingReader() = delete;
+
+    // Open the file at the specified path and start reading at offset,
+    // which must be a record boundary (such as zero or a saved
+    // GetRecordBoundary).  escape is the DSV escape character.  This
+    // throws FileOpenException if the file can't be opened.
+    TailingReader(const char *path, uint64_t offset = 0, char escape = '\\',
+      size_t block_size = DefaultBlockSize)
+      : Descriptor(open(path, O_RDONLY)), Notifier(-1), Buffer(block_size),
+        Current(nullptr), End(nullptr), Offset(offset), Boundary(offset),
+        Scanner(escape), CaughtUp(false), Truncated(false), ErrorValue(0) {
+        assert(this);
+        assert(path);
+        assert(block_size > 0);
+        if (Descriptor == -1) {
+            throw FileOpenException(path, errno);
+        }
+#if defined(LIBPT_INOTIFY)
+        Notifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (Notifier != -1 && inotify_add_watch(Notifier, path,
+          IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) == -1) {
+            close(Notifier);
+            Notifier = -1;
+        }
+#endif
+    }
+
+    TailingReader(const TailingReader &that) = delete;
+    TailingReader &operator=(const TailingReader &that) = delete;
+
+    ~TailingReader() {
+        assert(this);
+        if (Notifier != -1) {
+            close(Notifier);
+        }
+        close(Descriptor);
+    }
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !Fill()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !Fill()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !Fill()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    // Return true if the reader has caught up with the file.  This
+    // becomes false again when more is read.
+    inline bool IsEOF() { assert(this); return CaughtUp && Current == End; }
+
+    inline bool Error() { assert(this); return ErrorValue != 0; }
+    inline int GetErrno() const { assert(this); return ErrorValue; }
+
+    // Return true if the file has shrunk below the reader's offset.
+    bool IsTruncated() const { assert(this); return Truncated; }
+
+    // Start reading at offset, which must be a record boundary, after the
+    // file has been truncated or rewritten.  Reset the parser, too.
+    void Restart(uint64_t offset = 0) {
+        assert(this);
+        Offset = Boundary = offset;
+        Current = End = nullptr;
+        Scanner.Reset();
+        CaughtUp = Truncated = false;
+        ErrorValue = 0;
+    }
+
+    // Return the number of bytes read from the start of the file (i.e.,
+    // the offset of the next byte to be read).
+    uint64_t GetOffset() const { assert(this); return Offset; }
+
+    // Return the offset of the last record boundary in the blocks read so
+    // far: Every record before it is complete.
+    uint64_t GetRecordBoundary() const { assert(this); return Boundary; }
+
+    // Wait until the file has grown past the reader's offset or has been
+    // truncated, or until timeout milliseconds have passed (a negative
+    // timeout waits indefinitely).  Return true unless the wait timed out.
+    // Without inotify, this polls the file's size every PollInterval
+    // milliseconds.
+    bool Wait(int timeout) {
+        assert(this);
+        static const int PollInterval = 100;
+        auto deadline = std::chrono::steady_clock::now() +
+          std::chrono::milliseconds(timeout);
+        while (true) {
+            if (HasChanged()) {
+                return true;
+            }
+            auto interval = PollInterval;
+            if (timeout >= 0) {
+                auto left = std::chrono::duration_cast<
+                  std::chrono::milliseconds>(deadline -
+                    std::chrono::steady_clock::now()).count();
+                if (left <= 0) {
+                    return false;
+                } else if (left < interval) {
+                    interval = static_cast<int>(left);
+                }
+            }
+            if (Notifier != -1) {
+                // The file can grow between HasChanged and poll; the next
+                // wakeup catches it, so the interval bounds the delay.
+                struct pollfd descriptor = { Notifier, POLLIN, 0 };
+                if (poll(&descriptor, 1, interval) > 0) {
+                    Drain();
+                }
+            } else {
+                poll(nullptr, 0, interval);
+            }
+        }
+    }
+
+private:
+    // Return true if the file's size differs from the reader's offset.
+    bool HasChanged() {
+        assert(this);
+        struct stat info;
+        if (fstat(Descriptor, &info) == -1) {
+            return true;
+        }
+        return static_cast<uint64_t>(info.st_size) != Offset;
+    }
+
+    void Drain() {
+        assert(this);
+#if defined(LIBPT_INOTIFY)
+        char events[4096];
+        while (read(Notifier, events, sizeof(events)) > 0) {
+        }
+#endif
+    }
+
+    bool Fill() {
+        assert(this);
+        if (Truncated || ErrorValue != 0) {
+            return false;
+        }
+        ssize_t size;
+        while ((size = pread(Descriptor, Buffer.data(), Buffer.size(),
+          static_cast<off_t>(Offset))) == -1 && errno == EINTR) {
+        }
+        Current = End = Buffer.data();
+        if (size == -1) {
+            ErrorValue = errno;
+            CaughtUp = true;
+            return false;
+        } else if (size == 0) {
+            struct stat info;
+            if (fstat(Descriptor, &info) == 0 &&
+              static_cast<uint64_t>(info.st_size) < Offset) {
+                Truncated = true;
+            }
+            CaughtUp = true;
+            return false;
+        }
+        End += size;
+        TrackBoundary();
+        Offset += static_cast<uint64_t>(size);
+        CaughtUp = false;
+        return true;
+    }
+
+    // Update Boundary for the block that was just read.
+    void TrackBoundary() {
+        assert(this);
+        const char *last = nullptr;
+        auto start = Scanner.FindRecordStart(Current, End);
+        for (; start != End; start = Scanner.FindRecordStart(start, End)) {
+            last = start;
+        }
+        if (!Scanner.IsInRecord()) {
+            Boundary = Offset + static_cast<uint64_t>(End - Current);
+        } else if (last) {
+            Boundary = Offset + static_cast<uint64_t>(last - Current);
+        }
+    }
+
+    int Descriptor;
+    int Notifier;
+    std::vector<char> Buffer;
+
+    // the unread part of the buffer
+    const char *Current;
+    const char *End;
+
+    uint64_t Offset;
+    uint64_t Boundary;
+    DSVRecordScanner<char> Scanner;
+    bool CaughtUp;
+    bool Truncated;
+    int ErrorValue;
+
+};  // class TailingReader
+
+}   // namespace libpt
@@ -0,0 +1,303 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This header defines functions and classes for validating UTF-8 text.
+//
+// DSV separators, escapes, and newlines are ASCII, and no byte of a
+// multibyte UTF-8 sequence is ASCII, so char DSVParsers parse UTF-8 input
+// as raw bytes without decoding it: Fields are passed to Derived as
+// (valid or invalid) UTF-8.  The validators here check the bytes
+// separately, a buffer at a time, so parsers' loops stay byte-based.
+//
+// Validation skips runs of ASCII sixteen bytes at a time with SSE2 if the
+// compiler targets it (as indicated by __SSE2__) and eight bytes at a time
+// with 64-bit SWAR arithmetic otherwise.  Multibyte sequences are checked
+// a byte at a time.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <Exceptions.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace libpt {
+
+// Instances of this class validate UTF-8 text fed to them in arbitrary
+// pieces (such as readers' blocks).  A sequence may straddle pieces.  Text
+// is invalid if it contains overlong encodings, surrogates, code points
+// above U+10FFFF, or bytes that can't begin or continue a sequence there;
+// if the text ends in the middle of a sequence, Finish reports it.
+class UTF8Validator {
+
+public:
+    UTF8Validator() { assert(this); Reset(); }
+
+    // Validate the next piece of text.  Return false if it or any earlier
+    // piece is invalid.  Pieces fed after an error aren't examined.
+    bool Feed(const char *begin, const char *end) {
+        assert(this);
+        assert(begin <= end);
+        if (!Valid) {
+            return false;
+        }
+        auto invalid = Scan(begin, end);
+        if (invalid != end) {
+            Valid = false;
+            ErrorOffset = Remaining != 0 ? SequenceOffset :
+              Offset + static_cast<uint64_t>(invalid - begin);
+        }
+        Offset += static_cast<uint64_t>(end - begin);
+        return Valid;
+    }
+
+    // Check that the text didn't end in the middle of a sequence.  Return
+    // false if the text is invalid.
+    bool Finish() {
+        assert(this);
+        if (Valid && Remaining != 0) {
+            Valid = false;
+            ErrorOffset = SequenceOffset;
+        }
+        return Valid;
+    }
+
+    bool IsValid() const { assert(this); return Valid; }
+
+    // Return the offset (from the beginning of the first piece) of the
+    // first byte of the first invalid sequence.  This is only meaningful
+    // when IsValid returns false.
+    uint64_t GetErrorOffset() const { assert(this); return ErrorOffset; }
+
+    // Return the number of bytes fed so far.
+    uint64_t GetOffset() const { assert(this); return Offset; }
+
+    void Reset() {
+        assert(this);
+        Offset = ErrorOffset = SequenceOffset = 0;
+        Remaining = 0;
+        Lower = 0x80;
+        Upper = 0xBF;
+        Valid = true;
+    }
+
+private:
+    // Skip ASCII characters, returning a pointer to the first byte in
+    // [begin, end) that isn't ASCII or end if there is none.
+    static const char *SkipASCII(const char *begin, const char *end) {
+#if defined(__SSE2__)
+        while (end - begin >= 16) {
+            auto chars = _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(begin));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(chars));
+            if (mask) {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 16;
+        }
+#else
+        while (end - begin >= 8) {
+            uint64_t word;
+            memcpy(&word, begin, sizeof(word));
+            if (word & UINT64_C(0x8080808080808080)) {
+                break;
+            }
+            begin += 8;
+        }
+#endif
+        while (begin != end && !(*begin & 0x80)) {
+            ++begin;
+        }
+        return begin;
+    }
+
+    // Validate [begin, end), continuing any sequence that a previous piece
+    // left incomplete.  Return a pointer to the first invalid byte or end.
+    const char *Scan(const char *begin, const char *end) {
+        for (auto c = begin; c != end; ++c) {
+            auto byte = static_cast<unsigned char>(*c);
+            if (Remaining != 0) {
+                if (byte < Lower || byte > Upper) {
+                    return c;
+                }
+                --Remaining;
+                Lower = 0x80;
+                Upper = 0xBF;
+                continue;
+            }
+            if (byte < 0x80) {
+                c = SkipASCII(c, end);
+                if (c == end) {
+                    break;
+                }
+                byte = static_cast<unsigned char>(*c);
+            }
+            SequenceOffset = Offset + static_cast<uint64_t>(c - begin);
+
+            // The bounds of the second byte exclude overlong encodings,
+            // surrogates, and code points above U+10FFFF.
+            if (byte >= 0xC2 && byte <= 0xDF) {
+                Remaining = 1;
+            } else if (byte >= 0xE0 && byte <= 0xEF) {
+                Remaining = 2;
+                if (byte == 0xE0) {
+                    Lower = 0xA0;
+                } else if (byte == 0xED) {
+                    Upper = 0x9F;
+                }
+            } else if (byte >= 0xF0 && byte <= 0xF4) {
+                Remaining = 3;
+                if (byte == 0xF0) {
+                    Lower = 0x90;
+                } else if (byte == 0xF4) {
+                    Upper = 0x8F;
+                }
+            } else {
+                return c;
+            }
+        }
+        return end;
+    }
+
+    // the number of bytes fed before the current piece
+    uint64_t Offset;
+
+    uint64_t ErrorOffset;
+
+    // the offset of the current sequence's first byte
+    uint64_t SequenceOffset;
+
+    // the number of bytes left in the current sequence and the bounds of
+    // the next one
+    unsigned Remaining;
+    unsigned char Lower;
+    unsigned char Upper;
+
+    bool Valid;
+
+};  // class UTF8Validator
+
+// Return a pointer to the first byte of the first invalid (or incomplete)
+// UTF-8 sequence in [begin, end) or end if the text is valid.
+inline const char *FindInvalidUTF8(const char *begin, const char *end) {
+    assert(begin <= end);
+    UTF8Validator validator;
+    if (validator.Feed(begin, end) && validator.Finish()) {
+        return end;
+    }
+    return begin + validator.GetErrorOffset();
+}
+
+// Instances of this class pass the blocks of a Source reader, which must
+// implement ReadBlock and Error (see DSVParser::Parse), through unchanged
+// while validating them as UTF-8.  They implement ReadChar, TryReadChar,
+// ReadBlock, IsEOF, and Error, so parsers can read from them in place of
+// their sources.  Invalid text doesn't stop the stream: Error returns
+// true if the source failed or the text is invalid, and IsValid and
+// GetErrorOffset report the first invalid sequence.  The readers don't own
+// their sources: Others must keep them alive while they're used.
+template <typename Source>
+class UTF8ValidatingReader {
+
+public:
+    UTF8ValidatingReader() = delete;
+    UTF8ValidatingReader(Source *source)
+      : Input(source), Current(nullptr), End(nullptr), AtEnd(false) {
+        assert(this);
+        assert(source);
+    }
+
+    UTF8ValidatingReader(const UTF8ValidatingReader &that) = delete;
+    UTF8ValidatingReader &operator=(const UTF8ValidatingReader &that) =
+      delete;
+
+    inline char ReadChar() {
+        assert(this);
+        if (Current == End && !Fill()) {
+            throw EOFException(nullptr);
+        }
+        return *Current++;
+    }
+
+    inline bool TryReadChar(char *c) {
+        assert(this);
+        assert(c);
+        if (Current == End && !Fill()) {
+            return false;
+        }
+        *c = *Current++;
+        return true;
+    }
+
+    inline size_t ReadBlock(const char **block) {
+        assert(this);
+        assert(block);
+        if (Current == End && !Fill()) {
+            *block = Current;
+            return 0;
+        }
+        auto size = static_cast<size_t>(End - Current);
+        *block = Current;
+        Current = End;
+        return size;
+    }
+
+    inline bool IsEOF() { assert(this); return AtEnd && Current == End; }
+
+    inline bool Error() {
+        assert(this);
+        return !Validator.IsValid() || Input->Error();
+    }
+
+    // The text's validity is only final at the end of the stream.
+    bool IsValid() const { assert(this); return Validator.IsValid(); }
+
+    uint64_t GetErrorOffset() const {
+        assert(this);
+        return Validator.GetErrorOffset();
+    }
+
+    Source *GetSource() const { assert(this); return Input; }
+
+private:
+    bool Fill() {
+        assert(this);
+        if (AtEnd) {
+            return false;
+        }
+        auto size = Input->ReadBlock(&Current);
+        End = Current + size;
+        if (size == 0) {
+            AtEnd = true;
+            Validator.Finish();
+            return false;
+        }
+        Validator.Feed(Current, End);
+        return true;
+    }
+
+    Source *Input;
+    UTF8Validator Validator;
+
+    // the unread part of the source's current block
+    const char *Current;
+    const char *End;
+
+    bool AtEnd;
+
+};  // class UTF8ValidatingReader
+
+}   // namespace libpt
@@ -0,0 +1,464 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This is a self-contained benchmark harness for DSVParser, libpt's
+// readers, and StringToNumber.  It generates synthetic corpora, times each
+// combination several times, and prints one JSON object per line (JSON
+// Lines) with the best run's throughput, so results can be compared
+// across changes with any JSON tool.  Build it from the repository's top
+// directory with something like
+//
+//     g++ -std=c++11 -O2 -I. bench/Benchmark.cpp -o Benchmark
+//
+// and run it with these optional arguments:
+//
+//     --size MB       the approximate size of each corpus (default: 16)
+//     --min-time S    the minimum total time per benchmark (default: 0.5)
+//     --filter TEXT   only run benchmarks whose names contain TEXT
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <DSV.h>
+#include <FileReader.h>
+#include <MappedFileReader.h>
+#include <StringReader.h>
+#include <StringToNumber.h>
+
+using namespace libpt;
+
+namespace {
+
+// the command line options
+size_t CorpusSize = 16 * 1024 * 1024;
+double MinTime = 0.5;
+const char *Filter = "";
+
+// Benchmarks add their results to this so that the compiler can't
+// discard their work.
+volatile uint64_t Sink;
+
+// This is a generated DSV corpus.
+struct Corpus {
+    std::string Name;
+    std::string Text;
+    size_t RecordCount;
+};
+
+// This counts fields and characters, passing runs in bulk.
+class ChunkCounter : public DSVParser<ChunkCounter>,
+  public UnixDSVParser<> {
+
+public:
+    ChunkCounter() : Characters(0), Fields(0), Records(0) {}
+    ~ChunkCounter() { Reset(); }
+
+    void OnRecordStart() {}
+    void OnFieldChunk(const char *begin, const char *end) {
+        Characters += static_cast<size_t>(end - begin);
+    }
+    void OnFieldEnd() { ++Fields; }
+    void OnRecordEnd() { ++Records; }
+    void OnReset() {}
+
+    size_t Characters;
+    size_t Fields;
+    size_t Records;
+
+};  // class ChunkCounter
+
+// This counts fields and characters one character at a time, which
+// exercises HandleParsedCharacter.
+class CharacterCounter : public DSVParser<CharacterCounter>,
+  public UnixDSVParser<> {
+
+public:
+    CharacterCounter() : Characters(0), Fields(0), Records(0) {}
+    ~CharacterCounter() { Reset(); }
+
+    void OnRecordStart() {}
+    void OnFieldCharacter(char) { ++Characters; }
+    void OnFieldEnd() { ++Fields; }
+    void OnRecordEnd() { ++Records; }
+    void OnReset() {}
+
+    size_t Characters;
+    size_t Fields;
+    size_t Records;
+
+};  // class CharacterCounter
+
+// This hides Source's ReadBlock so that DSVParser::Parse reads a character
+// at a time with TryReadChar.
+template <typename Source>
+class TryReadCharReader {
+
+public:
+    explicit TryReadCharReader(Source &&source) : Input(std::move(source)) {}
+
+    char ReadChar() { return Input.ReadChar(); }
+    bool TryReadChar(char *c) { return Input.TryReadChar(c); }
+    bool IsEOF() { return Input.IsEOF(); }
+
+private:
+    Source Input;
+
+};  // class TryReadCharReader
+
+// This hides Source's ReadBlock and TryReadChar so that DSVParser::Parse
+// reads a character at a time with ReadChar and IsEOF.
+template <typename Source>
+class ReadCharReader {
+
+public:
+    explicit ReadCharReader(Source &&source) : Input(std::move(source)) {}
+
+    char ReadChar() { return Input.ReadChar(); }
+    bool IsEOF() { return Input.IsEOF(); }
+
+private:
+    Source Input;
+
+};  // class ReadCharReader
+
+bool IsSelected(const std::string &name) {
+    return strstr(name.c_str(), Filter) != nullptr;
+}
+
+// Run function until it has run at least three times and for at least
+// MinTime seconds in total and return the shortest time in seconds.
+template <typename Function>
+double Measure(Function function) {
+    double best = std::numeric_limits<double>::infinity();
+    double total = 0;
+    for (size_t runs = 0; runs < 3 || total < MinTime; ++runs) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+        total += elapsed.count();
+    }
+    return best;
+}
+
+void Report(const std::string &name, const std::string &corpus,
+  size_t bytes, size_t items, const char *item_name, double seconds) {
+    printf("{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, "
+      "\"%s\": %zu, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+      "\"%s_per_s\": %.0f}\n", name.c_str(), corpus.c_str(), bytes,
+      item_name, items, seconds, bytes / seconds / (1024 * 1024), item_name,
+      items / seconds);
+    fflush(stdout);
+}
+
+// Generate records until the corpus is at least CorpusSize bytes.
+// make_field appends one field to its string parameter; field_count is
+// the number of fields per record.
+template <typename FieldMaker>
+Corpus MakeCorpus(const char *name, size_t field_count,
+  FieldMaker make_field) {
+    Corpus corpus;
+    corpus.Name = name;
+    corpus.RecordCount = 0;
+    corpus.Text.reserve(CorpusSize + 4096);
+    while (corpus.Text.size() < CorpusSize) {
+        for (size_t index = 0; index < field_count; ++index) {
+            if (index != 0) {
+                corpus.Text.push_back(':');
+            }
+            make_field(&corpus.Text, index);
+        }
+        corpus.Text.push_back('\n');
+        ++corpus.RecordCount;
+    }
+    return corpus;
+}
+
+std::vector<Corpus> MakeCorpora() {
+    std::mt19937 random(42);
+    auto letters = [&random](std::string *text, size_t min, size_t max) {
+        auto size = min + random() % (max - min + 1);
+        for (size_t index = 0; index < size; ++index) {
+            text->push_back(static_cast<char>('a' + random() % 26));
+        }
+    };
+    std::vector<Corpus> corpora;
+    corpora.push_back(MakeCorpus("narrow_short", 4,
+      [&](std::string *text, size_t) { letters(text, 1, 8); }));
+    corpora.push_back(MakeCorpus("wide_short", 40,
+      [&](std::string *text, size_t) { letters(text, 1, 8); }));
+    corpora.push_back(MakeCorpus("narrow_long", 4,
+      [&](std::string *text, size_t) { letters(text, 100, 300); }));
+    corpora.push_back(MakeCorpus("escape_heavy", 6,
+      [&](std::string *text, size_t) {
+        auto size = 10 + random() % 21;
+        for (size_t index = 0; index < size; ++index) {
+            if (random() % 5 == 0) {
+                static const char specials[] = { ':', '\\', '\n' };
+                text->push_back('\\');
+                text->push_back(specials[random() % 3]);
+            } else {
+                text->push_back(static_cast<char>('a' + random() % 26));
+            }
+        }
+      }));
+    corpora.push_back(MakeCorpus("passwd_like", 7,
+      [&](std::string *text, size_t index) {
+        if (index == 2 || index == 3) {
+            *text += std::to_string(random() % 65536);
+        } else {
+            letters(text, 1, index == 4 ? 32 : 12);
+        }
+      }));
+    corpora.push_back(MakeCorpus("numeric", 5,
+      [&](std::string *text, size_t index) {
+        if (index % 2 == 0) {
+            *text += std::to_string(static_cast<int32_t>(random()));
+        } else {
+            *text += std::to_string(random() % 100000) + "." +
+              std::to_string(random() % 1000);
+        }
+      }));
+    return corpora;
+}
+
+template <typename Counter>
+void BenchmarkFeed(const char *name, const Corpus &corpus) {
+    if (!IsSelected(name)) {
+        return;
+    }
+    size_t records = 0;
+    auto seconds = Measure([&]() {
+        Counter counter;
+        counter.FeedCharacters(corpus.Text.data(),
+          corpus.Text.data() + corpus.Text.size());
+        counter.FinishParsing();
+        records = counter.Records;
+        Sink += counter.Characters + counter.Fields;
+    });
+    Report(name, corpus.Name, corpus.Text.size(), records, "records",
+      seconds);
+}
+
+template <typename Counter, typename Reader, typename ReaderMaker>
+void BenchmarkReader(const char *name, const Corpus &corpus,
+  ReaderMaker make_reader) {
+    if (!IsSelected(name)) {
+        return;
+    }
+    size_t records = 0;
+    auto seconds = Measure([&]() {
+        Reader reader = make_reader();
+        Counter counter;
+        counter.ParseOnly(reader);
+        records = counter.Records;
+        Sink += counter.Characters + counter.Fields;
+    });
+    Report(name, corpus.Name, corpus.Text.size(), records, "records",
+      seconds);
+}
+
+void BenchmarkParsing(const Corpus &corpus) {
+    BenchmarkFeed<ChunkCounter>("FeedCharacters/chunks", corpus);
+    BenchmarkFeed<CharacterCounter>("FeedCharacters/characters", corpus);
+    BenchmarkReader<ChunkCounter, StringReader<std::string>>(
+      "StringReader/chunks", corpus, [&]() {
+        return StringReader<std::string>(corpus.Text);
+      });
+    BenchmarkReader<ChunkCounter, CStringReader>("CStringReader/chunks",
+      corpus, [&]() { return CStringReader(corpus.Text.c_str()); });
+
+    // The file readers read a temporary copy of the corpus, which is
+    // likely to be in the page cache.
+    if (!IsSelected("FileReader/chunks") &&
+      !IsSelected("FileReader/chunked-characters") &&
+      !IsSelected("FileReader/TryReadChar") &&
+      !IsSelected("FileReader/ReadChar") &&
+      !IsSelected("MappedFileReader/chunks")) {
+        return;
+    }
+    auto file = tmpfile();
+    if (!file) {
+        perror("tmpfile");
+        return;
+    }
+    fwrite(corpus.Text.data(), 1, corpus.Text.size(), file);
+    fflush(file);
+    BenchmarkReader<ChunkCounter, FileReader>("FileReader/chunks", corpus,
+      [&]() {
+        rewind(file);
+        return FileReader(file);
+      });
+
+    // Parse reads blocks from FileReaders, so this measures
+    // OnFieldCharacter, not the reader's per-character methods.
+    BenchmarkReader<CharacterCounter, FileReader>(
+      "FileReader/chunked-characters", corpus, [&]() {
+        rewind(file);
+        return FileReader(file);
+      });
+    BenchmarkReader<ChunkCounter, TryReadCharReader<FileReader>>(
+      "FileReader/TryReadChar", corpus, [&]() {
+        rewind(file);
+        return TryReadCharReader<FileReader>(FileReader(file));
+      });
+    BenchmarkReader<ChunkCounter, ReadCharReader<FileReader>>(
+      "FileReader/ReadChar", corpus, [&]() {
+        rewind(file);
+        return ReadCharReader<FileReader>(FileReader(file));
+      });
+    if (IsSelected("MappedFileReader/chunks")) {
+        MappedFileReader mapping(fileno(file));
+        size_t records = 0;
+        auto seconds = Measure([&]() {
+            mapping.Rewind();
+            ChunkCounter counter;
+            counter.ParseOnly(mapping);
+            records = counter.Records;
+            Sink += counter.Characters + counter.Fields;
+        });
+        Report("MappedFileReader/chunks", corpus.Name, corpus.Text.size(),
+          records, "records", seconds);
+    }
+    fclose(file);
+}
+
+// These are the fields that the number benchmarks convert: null-terminated
+// for the C string forms and addressed by offsets for the others.
+struct Numbers {
+    std::string Name;
+    std::string Bytes;
+    std::vector<size_t> Offsets;
+    std::vector<std::string> Strings;
+};
+
+template <typename Maker>
+Numbers MakeNumbers(const char *name, Maker make_number) {
+    std::mt19937 random(7);
+    Numbers numbers;
+    numbers.Name = name;
+    numbers.Offsets.push_back(0);
+    auto count = std::max<size_t>(CorpusSize / 16, 1);
+    for (size_t index = 0; index < count; ++index) {
+        auto text = make_number(random);
+        numbers.Bytes += text;
+        numbers.Offsets.push_back(numbers.Bytes.size());
+        numbers.Strings.push_back(text);
+    }
+    return numbers;
+}
+
+template <typename T>
+void BenchmarkNumbers(const char *type_name, const Numbers &numbers) {
+    auto count = numbers.Strings.size();
+    auto bytes = numbers.Bytes.size();
+    auto name = std::string("StringToNumber<") + type_name + ">";
+    if (IsSelected(name)) {
+        auto seconds = Measure([&]() {
+            T sum = 0;
+            for (const auto &text : numbers.Strings) {
+                sum += StringToNumber<T>(text.c_str());
+            }
+            Sink += static_cast<uint64_t>(sum);
+        });
+        Report(name, numbers.Name, bytes, count, "values", seconds);
+    }
+    name = std::string("StringToNumber<") + type_name + ">/range";
+    if (IsSelected(name)) {
+        auto seconds = Measure([&]() {
+            T sum = 0;
+            const char *stop;
+            for (size_t index = 0; index < count; ++index) {
+                sum += StringToNumber<T>(
+                  numbers.Bytes.data() + numbers.Offsets[index],
+                  numbers.Bytes.data() + numbers.Offsets[index + 1], &stop);
+            }
+            Sink += static_cast<uint64_t>(sum);
+        });
+        Report(name, numbers.Name, bytes, count, "values", seconds);
+    }
+    name = std::string("StringsToNumbers<") + type_name + ">";
+    if (IsSelected(name)) {
+        std::vector<T> values(count);
+        std::vector<uint64_t> errors((count + 63) / 64);
+        auto seconds = Measure([&]() {
+            Sink += StringsToNumbers<T>(numbers.Bytes.data(),
+              numbers.Offsets.data(), count, values.data(), errors.data());
+            Sink += static_cast<uint64_t>(values[count / 2]);
+        });
+        Report(name, numbers.Name, bytes, count, "values", seconds);
+    }
+}
+
+void BenchmarkNumbers() {
+    auto small = MakeNumbers("small_integers", [](std::mt19937 &random) {
+        return std::to_string(random() % 30000);
+    });
+    auto large = MakeNumbers("large_integers", [](std::mt19937 &random) {
+        return std::to_string((static_cast<uint64_t>(random()) << 31) ^
+          random());
+    });
+    auto decimals = MakeNumbers("decimals", [](std::mt19937 &random) {
+        return std::to_string(random() % 1000000) + "." +
+          std::to_string(random() % 10000);
+    });
+    BenchmarkNumbers<short>("short", small);
+    BenchmarkNumbers<unsigned short>("unsigned short", small);
+    BenchmarkNumbers<int>("int", small);
+    BenchmarkNumbers<unsigned int>("unsigned int", small);
+    BenchmarkNumbers<long>("long", large);
+    BenchmarkNumbers<unsigned long>("unsigned long", large);
+    BenchmarkNumbers<long long>("long long", large);
+    BenchmarkNumbers<unsigned long long>("unsigned long long", large);
+    BenchmarkNumbers<float>("float", decimals);
+    BenchmarkNumbers<double>("double", decimals);
+    BenchmarkNumbers<long double>("long double", decimals);
+}
+
+void Usage(const char *program) {
+    fprintf(stderr, "usage: %s [--size MB] [--min-time SECONDS] "
+      "[--filter TEXT]\n", program);
+    exit(2);
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+    for (int index = 1; index < argc; ++index) {
+        if (index + 1 == argc) {
+            Usage(argv[0]);
+        } else if (strcmp(argv[index], "--size") == 0) {
+            CorpusSize = static_cast<size_t>(
+              atof(argv[++index]) * 1024 * 1024);
+        } else if (strcmp(argv[index], "--min-time") == 0) {
+            MinTime = atof(argv[++index]);
+        } else if (strcmp(argv[index], "--filter") == 0) {
+            Filter = argv[++index];
+        } else {
+            Usage(argv[0]);
+        }
+    }
+    for (const auto &corpus : MakeCorpora()) {
+        BenchmarkParsing(corpus);
+    }
+    BenchmarkNumbers();
+    return 0;
+}
@@ -0,0 +1,624 @@
+// libpt: Plain Text Manipulation
+// Written in 2015 by Jordan Vaughan
+
+// To the extent possible under law, the author(s) have dedicated all copyright
+// and related and neighboring rights to this software to the public domain
+// worldwide. This software is distributed without any warranty.
+
+// You should have received a copy of the CC0 Public Domain Dedication along
+// with this software. If not, see
+// <http://creativecommons.org/publicdomain/zero/1.0/>.
+
+// This is a self-contained program of regression tests.  Build it from the
+// repository's top directory with something like
+//
+//     g++ -std=c++11 -O2 -I. tests/Tests.cpp -o Tests -pthread
+//
+// and run it without arguments.  It prints each failed check and exits
+// with status 1 if any failed.  The DSVRecordView tests require C++17, so
+// they're only built with -std=c++17 or later.
+
+#include <algorithm>
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <DSV.h>
+#include <DSVBinding.h>
+#include <DSVCheckpoint.h>
+#include <DSVFilter.h>
+#include <DSVIndex.h>
+#include <ParallelDSV.h>
+#include <StringToNumber.h>
+
+#if __cplusplus >= 201703L
+#include <DSVRecordView.h>
+#endif
+
+using namespace libpt;
+
+namespace {
+
+int Failures = 0;
+
+void Check(bool passed, const char *test, const char *what) {
+    if (!passed) {
+        fprintf(stderr, "%s: failed: %s\n", test, what);
+        ++Failures;
+    }
+}
+
+#define CHECK(test, expression) Check((expression), (test), #expression)
+
+typedef std::vector<std::vector<std::string>> Records;
+
+// This is the reference parser for the other parsers: It's fed one
+// character at a time and gathers the records' fields one character at a
+// time.
+class RecordGatherer : public DSVParser<RecordGatherer, char,
+  UnixDSVDelimiters<>> {
+
+public:
+    ~RecordGatherer() { Reset(); }
+
+    void OnRecordStart() { Record.clear(); Record.emplace_back(); }
+    void OnFieldCharacter(char c) { Record.back() += c; }
+    void OnFieldEnd() { Record.emplace_back(); }
+    void OnRecordEnd() { Record.pop_back(); Gathered.push_back(Record); }
+    void OnReset() {}
+
+    Records Gathered;
+
+private:
+    std::vector<std::string> Record;
+
+};  // class RecordGatherer
+
+Records ParseRecords(const std::string &text) {
+    RecordGatherer gatherer;
+    for (auto c : text) {
+        gatherer.FeedCharacter(c);
+    }
+    gatherer.FinishParsing();
+    return gatherer.Gathered;
+}
+
+// Return count records of Unix DSV text with short fields that are full of
+// separators, escapes, and newlines, all escaped, and ordinary characters,
+// some of them needlessly escaped.  There are also empty lines, and the
+// last record may lack a newline.
+std::string MakeDSVText(std::mt19937 &random, size_t count) {
+    static const char characters[] = "ab:\\\nabcab";
+    std::string text;
+    for (size_t record = 0; record < count; ++record) {
+        if (random() % 8 == 0) {
+            text += '\n';
+        }
+        auto fields = 1 + random() % 4;
+        for (size_t field = 0; field < fields; ++field) {
+            if (field != 0) {
+                text += ':';
+            }
+            for (auto size = random() % 6; size != 0; --size) {
+                auto c = characters[random() % (sizeof(characters) - 1)];
+                if (c == ':' || c == '\\' || c == '\n' ||
+                  random() % 8 == 0) {
+                    text += '\\';
+                }
+                text += c;
+            }
+        }
+        if (record + 1 != count || random() % 2 == 0) {
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+// Instances of this class read a string in blocks of a fixed size.  They
+// can seek, so they can stand in for files.
+class BlockReader {
+
+public:
+    BlockReader(const std::string &text, size_t block_size)
+      : Text(text), BlockSize(block_size), Offset(0) {}
+
+    size_t ReadBlock(const char **block) {
+        auto size = std::min(BlockSize, Text.size() - Offset);
+        *block = Text.data() + Offset;
+        Offset += size;
+        return size;
+    }
+
+    bool Error() { return false; }
+    void Seek(uint64_t offset) { Offset = static_cast<size_t>(offset); }
+
+private:
+    const std::string &Text;
+    size_t BlockSize;
+    size_t Offset;
+
+};  // class BlockReader
+
+// Create an empty temporary file and return its path.
+std::string MakeTemporaryFile() {
+    char path[] = "/tmp/libpt-tests-XXXXXX";
+    auto descriptor = mkstemp(path);
+    if (descriptor == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(descriptor);
+    return path;
+}
+
+// Return true if the file at path exists.
+bool FileExists(const std::string &path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// This skips every record after its first field and counts the calls it
+// gets.
+class SkippingCounter : public DSVParser<SkippingCounter, char,
+  UnixDSVDelimiters<>, DSVStatistics> {
+
+public:
+    SkippingCounter() : FieldEnds(0), RecordEnds(0) {}
+    ~SkippingCounter() { Reset(); }
+
+    void OnRecordStart() {}
+    void OnFieldCharacter(char) {}
+    void OnFieldEnd() { ++FieldEnds; }
+    void OnRecordEnd() { ++RecordEnds; }
+    void OnReset() {}
+    bool ShouldSkipRecord() { return true; }
+
+    size_t FieldEnds;
+    size_t RecordEnds;
+
+};  // class SkippingCounter
+
+// A skipped final record without a newline must not end its last field
+// again in FinishParsing.
+void TestSkippedFinalRecord() {
+    static const char *const inputs[] = { "a:b:c", "a:b:c\n" };
+    for (auto input : inputs) {
+        SkippingCounter parser;
+        std::string text(input);
+        parser.FeedCharacters(text.data(), text.data() + text.size());
+        parser.FinishParsing();
+        CHECK(input, parser.FieldEnds == 1);
+        CHECK(input, parser.RecordEnds == 0);
+        CHECK(input, parser.GetStatistics().GetFields() == 1);
+        CHECK(input, parser.GetStatistics().GetSkippedRecords() == 1);
+    }
+}
+
+// Ranges too long for StringToNumber's stack buffer must be converted
+// whole, not truncated.
+void TestLongFloatRanges() {
+    auto text = "1" + std::string(400, '0');
+    const char *stop;
+    errno = 0;
+    auto value = StringToNumber<double>(text.data(),
+      text.data() + text.size(), &stop);
+    CHECK("long float", std::isinf(value));
+    CHECK("long float", errno == ERANGE);
+    CHECK("long float", stop == text.data() + text.size());
+    text = "0x" + std::string(200, '0') + "1p4";
+    value = StringToNumber<double>(text.data(), text.data() + text.size(),
+      &stop);
+    CHECK("long hexadecimal float", value == 16);
+    CHECK("long hexadecimal float", stop == text.data() + text.size());
+}
+
+struct Account {
+    DSVField<char> Name;
+    uint32_t Uid;
+    std::string Home;
+};
+
+typedef DSVSchema<Account,
+  DSVBoundField<Account, DSVField<char>, &Account::Name>,
+  DSVIgnoredField,
+  DSVBoundField<Account, uint32_t, &Account::Uid>,
+  DSVBoundField<Account, std::string, &Account::Home>> AccountSchema;
+
+// This binds comma-separated records with the default (run-time)
+// delimiters.
+class CommaAccountBinder : public DSVRecordBinder<CommaAccountBinder,
+  AccountSchema> {
+
+public:
+    CommaAccountBinder() : Records(0), Uid(0), Errors(0) {}
+    ~CommaAccountBinder() { Reset(); }
+
+    char GetSeparator() const { return ','; }
+    char GetEscape() const { return '\\'; }
+
+    void OnRecord(const Account &account) {
+        ++Records;
+        Name.assign(account.Name.Data, account.Name.Size);
+        Uid = account.Uid;
+        Home = account.Home;
+        Errors = GetFieldErrors();
+    }
+
+    size_t Records;
+    std::string Name;
+    uint32_t Uid;
+    std::string Home;
+    uint64_t Errors;
+
+};  // class CommaAccountBinder
+
+// A binder whose Derived defines GetSeparator and GetEscape must use them.
+void TestBindingRunTimeDelimiters() {
+    CommaAccountBinder binder;
+    std::string text("ali\\,ce,x,42,/home/alice\n");
+    binder.FeedCharacters(text.data(), text.data() + text.size());
+    binder.FinishParsing();
+    CHECK("binding", binder.Records == 1);
+    CHECK("binding", binder.Name == "ali,ce");
+    CHECK("binding", binder.Uid == 42);
+    CHECK("binding", binder.Home == "/home/alice");
+    CHECK("binding", binder.Errors == 0);
+}
+
+// Long ranges, which strtod converts, mustn't depend on LC_NUMERIC.  This
+// only tests anything if a locale with a decimal comma is installed.
+void TestFloatRangesIgnoreLocale() {
+    static const char *const locales[] = {
+      "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8", "de_DE" };
+    auto found = false;
+    for (auto locale : locales) {
+        if (setlocale(LC_NUMERIC, locale)) {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return;
+    }
+    auto text = "1.5" + std::string(200, '0');
+    const char *stop;
+    auto value = StringToNumber<double>(text.data(),
+      text.data() + text.size(), &stop);
+    setlocale(LC_NUMERIC, "C");
+    CHECK("float locale", value == 1.5);
+    CHECK("float locale", stop == text.data() + text.size());
+}
+
+// A filter must find the same records as a full parse, even those whose
+// fields needlessly escape ordinary characters, and whether it filters
+// contiguous text or blocks.
+void TestFilterMatchesFullParse() {
+    static const char *const patterns[] = { "", "a", "ab", "a:b", "b\\",
+      "a\nb", "ca" };
+    std::mt19937 random(30);
+    for (size_t round = 0; round < 200; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 200);
+        auto records = ParseRecords(text);
+        for (auto pattern : patterns) {
+            auto field = random() % 3;
+            auto mode = random() % 2 ? DSVFilterMode::Prefix
+              : DSVFilterMode::Equal;
+            Records expected;
+            for (auto &record : records) {
+                if (field < record.size() && (mode == DSVFilterMode::Equal
+                  ? record[field] == pattern
+                  : record[field].compare(0, strlen(pattern), pattern) ==
+                    0)) {
+                    expected.push_back(record);
+                }
+            }
+            DSVRecordFilter<char> filter(field, pattern, mode);
+            std::string matched;
+            auto count = filter.Filter(text.data(),
+              text.data() + text.size(),
+              [&matched](const char *begin, const char *end) {
+                  matched.append(begin, end);
+              });
+            CHECK("filter", count == expected.size());
+            CHECK("filter", ParseRecords(matched) == expected);
+            BlockReader reader(text, 1 + random() % 64);
+            matched.clear();
+            count = filter.Filter(reader,
+              [&matched](const char *begin, const char *end) {
+                  matched.append(begin, end);
+              });
+            CHECK("filter blocks", count == expected.size());
+            CHECK("filter blocks", ParseRecords(matched) == expected);
+        }
+    }
+}
+
+// This gathers records with DSVSpanParser and notes whether it passed any
+// fields without copying them.
+class SpanGatherer : public DSVSpanParser<SpanGatherer, char,
+  UnixDSVDelimiters<>> {
+
+public:
+    SpanGatherer(const std::string &input)
+      : Input(input), Uncopied(false) {}
+    ~SpanGatherer() { Reset(); }
+
+    void OnRecordStart() { Record.clear(); }
+
+    void OnField(const DSVField<char> &field) {
+        Record.emplace_back(field.Data, field.Size);
+        if (field.Size != 0 && field.Data >= Input.data() &&
+          field.Data < Input.data() + Input.size()) {
+            Uncopied = true;
+        }
+    }
+
+    void OnRecordEnd() { Gathered.push_back(Record); }
+
+    const std::string &Input;
+    Records Gathered;
+    bool Uncopied;
+
+private:
+    std::vector<std::string> Record;
+
+};  // class SpanGatherer
+
+// DSVSpanParser must gather the same records as the reference parser no
+// matter how its input is split, including between escapes and the
+// characters they escape.
+void TestSpanParserMatchesReference() {
+    std::mt19937 random(14);
+    for (size_t round = 0; round < 500; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        SpanGatherer gatherer(text);
+        for (size_t offset = 0; offset != text.size(); ) {
+            auto size = std::min<size_t>(random() % 12, text.size() - offset);
+            if (size == 0) {
+                gatherer.FeedCharacter(text[offset++]);
+            } else {
+                gatherer.FeedBuffer(text.data() + offset, size);
+                offset += size;
+            }
+        }
+        gatherer.FinishParsing();
+        CHECK("span parser", gatherer.Gathered == ParseRecords(text));
+    }
+    std::string text("abc:d\\:ef\n");
+    SpanGatherer gatherer(text);
+    gatherer.FeedCharacters(text.data(), text.data() + text.size());
+    gatherer.FinishParsing();
+    CHECK("span parser", gatherer.Gathered == Records(1,
+      std::vector<std::string>{ "abc", "d:ef" }));
+    CHECK("span parser", gatherer.Uncopied);
+}
+
+// This gathers the records that ParallelDSVParser delivers.
+struct ParallelGatherer {
+    void OnRecord(const DSVField<char> *fields, size_t field_count) {
+        Gathered.emplace_back();
+        for (size_t index = 0; index < field_count; ++index) {
+            Gathered.back().emplace_back(fields[index].Data,
+              fields[index].Size);
+        }
+    }
+
+    Records Gathered;
+};
+
+// ParallelDSVParser must deliver the same records as the reference parser,
+// in order, even when there are many more chunks than records, so chunks
+// are nominally split between escapes and the characters they escape.
+void TestParallelParserInOrder() {
+    std::mt19937 random(9);
+    for (size_t round = 0; round < 200; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        auto expected = ParseRecords(text);
+        ParallelDSVParser<char> parser(1 + random() % 4,
+          1 + random() % 64);
+        ParallelGatherer gatherer;
+        parser.Parse(text.data(), text.data() + text.size(), gatherer);
+        CHECK("parallel parser", gatherer.Gathered == expected);
+        ParallelDSVParser<char, UnixDSVDelimiters<>> unix_parser(
+          1 + random() % 4, text.size() + 1);
+        ParallelGatherer unix_gatherer;
+        unix_parser.Parse(text.data(), text.data() + text.size(),
+          unix_gatherer, DSVRecordOrder::Unordered);
+        std::sort(expected.begin(), expected.end());
+        std::sort(unix_gatherer.Gathered.begin(),
+          unix_gatherer.Gathered.end());
+        CHECK("parallel parser", unix_gatherer.Gathered == expected);
+    }
+}
+
+// A saved and reloaded DSVRecordIndex must be the same as the original
+// and parse the same records as the reference parser.  Saves must replace
+// existing files without leaving temporary files behind.
+void TestRecordIndexRoundTrip() {
+    std::mt19937 random(23);
+    auto path = MakeTemporaryFile();
+    for (size_t round = 0; round < 100; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        auto expected = ParseRecords(text);
+        DSVRecordIndex index(1 + random() % 8);
+        BlockReader reader(text, 1 + random() % 64);
+        index.Build(reader);
+        CHECK("record index", index.GetRecordCount() == expected.size());
+        CHECK("record index", index.GetInputSize() == text.size());
+        index.Save(path.c_str());
+        CHECK("record index", !FileExists(path + ".tmp"));
+        DSVRecordIndex loaded;
+        loaded.Load(path.c_str());
+        CHECK("record index", loaded.GetInterval() == index.GetInterval());
+        CHECK("record index", loaded.GetEscape() == index.GetEscape());
+        CHECK("record index",
+          loaded.GetRecordCount() == index.GetRecordCount());
+        CHECK("record index", loaded.GetInputSize() == index.GetInputSize());
+        CHECK("record index", loaded.GetOffsets() == index.GetOffsets());
+        auto first = random() % (expected.size() + 1);
+        auto count = random() % 4;
+        RecordGatherer gatherer;
+        auto parsed = ParseDSVRecords(loaded, reader, gatherer, first,
+          count);
+        auto last = std::min<size_t>(first + count, expected.size());
+        CHECK("record index", parsed == last - first);
+        CHECK("record index", gatherer.Gathered == Records(
+          expected.begin() + first, expected.begin() + last));
+    }
+    remove(path.c_str());
+    auto missing = path + "/index";
+    auto threw = false;
+    try {
+        DSVRecordIndex().Save(missing.c_str());
+    } catch (const FileOpenException &) {
+        threw = true;
+    }
+    CHECK("record index", threw);
+    CHECK("record index", !FileExists(missing + ".tmp"));
+}
+
+// A DSVKeyIndex must find the first record with each key, compared after
+// unescaping, and parse it as the reference parser does.
+void TestKeyIndexMatchesFullParse() {
+    std::mt19937 random(24);
+    for (size_t round = 0; round < 200; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        auto records = ParseRecords(text);
+        auto field = random() % 3;
+        DSVKeyIndex<char> index(field);
+        index.Build(text.data(), text.data() + text.size());
+        size_t keyed = 0;
+        for (auto &record : records) {
+            if (field >= record.size()) {
+                continue;
+            }
+            ++keyed;
+            auto &key = record[field];
+            auto first = std::find_if(records.begin(), records.end(),
+              [&](const std::vector<std::string> &other) {
+                  return field < other.size() && other[field] == key;
+              });
+            RecordGatherer gatherer;
+            CHECK("key index", index.ParseRecord(key, gatherer));
+            CHECK("key index", gatherer.Gathered == Records(1, *first));
+        }
+        CHECK("key index", index.GetRecordCount() == keyed);
+        CHECK("key index", !index.Find(std::string("zzz")));
+    }
+}
+
+// This is RecordGatherer with statistics and public state, so that it can
+// be checkpointed in the middle of a record.
+class CheckpointGatherer : public DSVParser<CheckpointGatherer, char,
+  UnixDSVDelimiters<>, DSVStatistics> {
+
+public:
+    ~CheckpointGatherer() { Reset(); }
+
+    void OnRecordStart() { Record.clear(); Record.emplace_back(); }
+    void OnFieldCharacter(char c) { Record.back() += c; }
+    void OnFieldEnd() { Record.emplace_back(); }
+    void OnRecordEnd() { Record.pop_back(); Gathered.push_back(Record); }
+    void OnReset() {}
+
+    Records Gathered;
+    std::vector<std::string> Record;
+
+};  // class CheckpointGatherer
+
+// A parser restored from a saved and reloaded DSVCheckpoint must finish
+// parsing as if it had never stopped, even if it stopped after an escape,
+// and saves must replace existing files without leaving temporary files
+// behind.
+void TestCheckpointRoundTrip() {
+    std::mt19937 random(26);
+    auto path = MakeTemporaryFile();
+    for (size_t round = 0; round < 200; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        auto offset = random() % (text.size() + 1);
+        CheckpointGatherer before;
+        before.FeedCharacters(text.data(), text.data() + offset);
+        DSVCheckpoint checkpoint;
+        checkpoint.Capture(before, offset);
+        checkpoint.Save(path.c_str());
+        CHECK("checkpoint", !FileExists(path + ".tmp"));
+        DSVCheckpoint loaded;
+        loaded.Load(path.c_str());
+        CHECK("checkpoint", loaded.GetOffset() == offset);
+        CHECK("checkpoint",
+          loaded.GetState().Escaping == before.GetState().Escaping);
+        CHECK("checkpoint",
+          loaded.GetState().InRecord == before.GetState().InRecord);
+        CHECK("checkpoint", loaded.GetCounterCount() ==
+          DSVStatistics::CounterCount);
+        CheckpointGatherer after;
+        loaded.Restore(after);
+        after.Gathered = before.Gathered;
+        after.Record = before.Record;
+        after.FeedCharacters(text.data() + loaded.GetOffset(),
+          text.data() + text.size());
+        after.FinishParsing();
+        auto expected = ParseRecords(text);
+        CHECK("checkpoint", after.Gathered == expected);
+        CHECK("checkpoint",
+          after.GetStatistics().GetCharacters() == text.size());
+        CHECK("checkpoint",
+          after.GetStatistics().GetRecords() == expected.size());
+    }
+    remove(path.c_str());
+}
+
+#if __cplusplus >= 201703L
+
+// DSVRecordReaders must read the same records as the reference parser,
+// and records' texts must be their raw lines.
+void TestRecordReaderMatchesReference() {
+    std::mt19937 random(7);
+    for (size_t round = 0; round < 500; ++round) {
+        auto text = MakeDSVText(random, 1 + random() % 50);
+        DSVRecordReader<char> reader(text);
+        DSVRecordView<char> view;
+        Records read;
+        std::string raw;
+        while (reader.ReadRecord(&view)) {
+            read.emplace_back(view.begin(), view.end());
+            raw.append(view.GetText().data(), view.GetText().size());
+            raw += '\n';
+        }
+        auto expected = ParseRecords(text);
+        CHECK("record reader", read == expected);
+        CHECK("record reader", ParseRecords(raw) == expected);
+    }
+}
+
+#endif
+
+}   // namespace
+
+int main() {
+    TestSkippedFinalRecord();
+    TestLongFloatRanges();
+    TestFloatRangesIgnoreLocale();
+    TestBindingRunTimeDelimiters();
+    TestFilterMatchesFullParse();
+    TestSpanParserMatchesReference();
+    TestParallelParserInOrder();
+    TestRecordIndexRoundTrip();
+    TestKeyIndexMatchesFullParse();
+    TestCheckpointRoundTrip();
+#if __cplusplus >= 201703L
+    TestRecordReaderMatchesReference();
+#endif
+    if (Failures != 0) {
+        fprintf(stderr, "%d checks failed\n", Failures);
+        return 1;
+    }
+    return 0;
+}